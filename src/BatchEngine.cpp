@@ -0,0 +1,221 @@
+#include "BatchEngine.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include "Hash.hpp"
+#include "Lockstep.hpp"
+
+#include <algorithm>
+
+namespace tools::chip8 {
+
+BatchEngine::BatchEngine(size_t instances, unsigned threads) : _pool(threads) {
+    _size = instances;
+    _slots = std::make_unique<Slot[]>(_size);
+
+    // Neighbouring machines are stepped by the same thread, give each group
+    // its own arena rather than having every thread lock PageArena::shared().
+    std::shared_ptr<PageArena> arena;
+    for (size_t i = 0 ; i < _size ; ++i) {
+        if (i % Lockstep::LANES == 0)
+            arena = std::make_shared<PageArena>();
+        _slots[i].cpu.set_page_arena(arena);
+    }
+}
+
+BatchEngine::~BatchEngine() {}
+
+size_t BatchEngine::size() {
+    return _size;
+}
+
+unsigned BatchEngine::threads() {
+    return _pool.size();
+}
+
+BatchEngine::Slot &BatchEngine::slot(size_t index) {
+    return _slots[index];
+}
+
+Chip8 &BatchEngine::instance(size_t index) {
+    return _slots[index].cpu;
+}
+
+bool BatchEngine::load_rom(const std::vector<uint8_t> &rom) {
+    // Every machine maps the same pages.
+    std::shared_ptr<const RomImage> image = RomImage::create(rom);
+    if (!image) {
+        SPDLOG_ERROR("Rom is too large to be loaded into memory. Size is {} bytes.", rom.size());
+        return false;
+    }
+
+    _image = std::move(image);
+    for (size_t i = 0 ; i < _size ; ++i)
+        reset_instance(i);
+    return true;
+}
+
+void BatchEngine::reset_instance(size_t index) {
+    Slot &slot = _slots[index];
+    slot.cpu.reset();
+    if (_image)
+        slot.cpu.load_rom(_image);
+
+    slot.executed = 0;
+    slot.frames = 0;
+    slot.remainder = 0;
+    slot.halted = false;
+}
+
+void BatchEngine::seed(uint64_t seed) {
+    for (size_t i = 0 ; i < _size ; ++i)
+        _slots[i].cpu.seed(hash_term(seed, i));
+}
+
+void BatchEngine::set_backend(Chip8::Backend backend) {
+    for (size_t i = 0 ; i < _size ; ++i)
+        _slots[i].cpu.set_backend(backend);
+}
+
+bool BatchEngine::set_quirks_profile(const std::string &name) {
+    for (size_t i = 0 ; i < _size ; ++i) {
+        if (!_slots[i].cpu.set_quirks_profile(name))
+            return false;
+    }
+    return true;
+}
+
+void BatchEngine::set_cpu_freq(uint32_t cpu_freq) {
+    if (cpu_freq < 60) {
+        SPDLOG_ERROR("CPU frequency must be at least 60 Hz.");
+        return;
+    }
+    _cpu_freq = cpu_freq;
+}
+
+void BatchEngine::set_fast_forward(bool fast_forward) {
+    _fast_forward = fast_forward;
+}
+
+void BatchEngine::set_lockstep(bool lockstep) {
+    _lockstep = lockstep;
+}
+
+uint64_t BatchEngine::get_lockstep_count() {
+    return _lockstep_count;
+}
+
+void BatchEngine::step(uint32_t frames, size_t grain) {
+    if (_lockstep) {
+        size_t groups = (_size + Lockstep::LANES - 1) / Lockstep::LANES;
+        size_t group_grain = std::max<size_t>(1, grain / Lockstep::LANES);
+        _pool.parallel_for(groups, group_grain, [this, frames](size_t begin, size_t end) {
+            for (size_t group = begin ; group < end ; ++group) {
+                size_t first = group * Lockstep::LANES;
+                step_group(first, std::min(first + Lockstep::LANES, _size), frames);
+            }
+        });
+        return;
+    }
+
+    _pool.parallel_for(_size, grain, [this, frames](size_t begin, size_t end) {
+        for (size_t i = begin ; i < end ; ++i)
+            step_instance(i, frames);
+    });
+}
+
+void BatchEngine::step_instance(size_t index, uint32_t frames) {
+    Slot &slot = _slots[index];
+    // Fast forward counts the skipped timer ticks in slot.frames.
+    uint64_t last = slot.frames + frames;
+    while (slot.frames < last && !slot.halted)
+        step_frame(slot, last);
+}
+
+void BatchEngine::step_group(size_t begin, size_t end, uint32_t frames) {
+    Lockstep lockstep;
+    Chip8 *cpus[Lockstep::LANES];
+    Slot *slots[Lockstep::LANES];
+    uint32_t budgets[Lockstep::LANES];
+    uint64_t lasts[Lockstep::LANES];
+    Chip8::RunResult results[Lockstep::LANES];
+
+    // Frame count each machine stops at, fast forward counts the skipped
+    // timer ticks in slot.frames.
+    uint64_t group_lasts[Lockstep::LANES];
+    for (size_t i = begin ; i < end ; ++i)
+        group_lasts[i - begin] = _slots[i].frames + frames;
+
+    for (;;) {
+        int count = 0;
+        for (size_t i = begin ; i < end ; ++i) {
+            Slot &slot = _slots[i];
+            if (slot.halted || slot.frames >= group_lasts[i - begin])
+                continue;
+            slots[count] = &slot;
+            lasts[count] = group_lasts[i - begin];
+            cpus[count] = &slot.cpu;
+            budgets[count] = frame_budget(slot);
+            ++count;
+        }
+
+        if (count == 0)
+            break;
+
+        lockstep.run(cpus, count, budgets, results);
+
+        for (int lane = 0 ; lane < count ; ++lane) {
+            uint32_t budget = budgets[lane];
+            bool more = handle(*slots[lane], results[lane], budget, lasts[lane]);
+            finish_frame(*slots[lane], more ? budget : 0, lasts[lane]);
+        }
+    }
+
+    _lockstep_count += lockstep.get_lockstep_count();
+}
+
+void BatchEngine::step_frame(Slot &slot, uint64_t last) {
+    finish_frame(slot, frame_budget(slot), last);
+}
+
+uint32_t BatchEngine::frame_budget(Slot &slot) {
+    // Spread cpu_freq instructions over 60 frames without drifting.
+    slot.remainder += _cpu_freq;
+    uint32_t budget = slot.remainder / 60;
+    slot.remainder %= 60;
+    return budget;
+}
+
+bool BatchEngine::handle(Slot &slot, const Chip8::RunResult &result, uint32_t &budget, uint64_t last) {
+    using StopReason = Chip8::StopReason;
+
+    slot.executed += result.executed;
+    budget -= result.executed;
+
+    if (result.reason == StopReason::halt_loop) {
+        slot.halted = true;
+        return false;
+    }
+    else if (result.reason == StopReason::idle && _fast_forward) {
+        // The skipped timer ticks are emulated frames too,
+        // stop short of the last one, it ends in finish_frame().
+        uint64_t left = last - slot.frames - 1;
+        uint8_t ticks = slot.cpu.fast_forward_timers(left < 0xff ? left : 0xff);
+        slot.frames += ticks;
+        if (ticks > 0)
+            return true;
+    }
+
+    // No input comes from here, nothing happens until the next frame.
+    return result.reason != StopReason::idle
+        && result.reason != StopReason::waiting_for_key;
+}
+
+void BatchEngine::finish_frame(Slot &slot, uint32_t budget, uint64_t last) {
+    while (budget > 0 && handle(slot, slot.cpu.run(budget), budget, last));
+
+    slot.cpu.decrease_timers();
+    ++slot.frames;
+}
+
+} // namespace tools::chip8
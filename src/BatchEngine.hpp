@@ -0,0 +1,140 @@
+#ifndef BATCHENGINE_HPP
+#define BATCHENGINE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Chip8.hpp"
+#include "ThreadPool.hpp"
+
+namespace tools::chip8 {
+
+/**
+ * @brief Many independent machines stepped a frame at a time on a thread pool.
+ * Machines do not share any state, so results do not depend on the
+ * number of threads nor on which thread ran which machine.
+ */
+class BatchEngine {
+    public:
+
+    // Per machine state, on its own cache lines so that threads do not contend.
+    struct alignas(64) Slot {
+        Chip8 cpu;
+        uint64_t executed = 0;
+        uint64_t frames = 0;
+        // Remainder of cpu_freq / 60 carried over to the next frame.
+        uint32_t remainder = 0;
+        // Reached a jump to itself, not stepped anymore.
+        bool halted = false;
+    };
+
+    /**
+     * @param threads See ThreadPool.
+     */
+    BatchEngine(size_t instances, unsigned threads = 0);
+    ~BatchEngine();
+
+    size_t size();
+    unsigned threads();
+
+    Slot &slot(size_t index);
+    Chip8 &instance(size_t index);
+
+    /**
+     * @brief Reset every machine and load the same rom in all of them.
+     */
+    bool load_rom(const std::vector<uint8_t> &rom);
+
+    /**
+     * @brief Reset one machine and map the rom loaded by load_rom() again.
+     * The generator state is kept, see Chip8::seed().
+     */
+    void reset_instance(size_t index);
+
+    /**
+     * @brief Seed machine i with a value derived from seed and i.
+     */
+    void seed(uint64_t seed);
+
+    void set_backend(Chip8::Backend backend);
+    bool set_quirks_profile(const std::string &name);
+
+    /**
+     * @param cpu_freq Instructions per second of emulated time, at least 60.
+     */
+    void set_cpu_freq(uint32_t cpu_freq);
+
+    /**
+     * @brief Skip delay timer waits instead of idling out the frame,
+     * see Chip8::fast_forward_timers().
+     */
+    void set_fast_forward(bool fast_forward);
+
+    /**
+     * @brief Step groups of Lockstep::LANES neighbouring machines together,
+     * see Lockstep. Results are the same as without.
+     * Pays off when machines mostly agree, e.g. same rom with different inputs;
+     * machines drawing random values every frame run slower.
+     */
+    void set_lockstep(bool lockstep);
+
+    /**
+     * @return Instructions executed in lockstep, counted once per lane.
+     */
+    uint64_t get_lockstep_count();
+
+    /**
+     * @brief Run every machine for a number of frames of 1/60 s.
+     * @param grain Machines per work item.
+     */
+    void step(uint32_t frames, size_t grain = 16);
+
+    /**
+     * @brief Run one machine for a number of frames, without lockstep.
+     * Different machines can be stepped from different threads.
+     */
+    void step_instance(size_t index, uint32_t frames);
+
+    /**
+     * @brief Call fn(begin, end) on ranges of machine indices from the pool threads,
+     * see ThreadPool::parallel_for().
+     */
+    template <typename Function>
+    void parallel_for(size_t grain, Function &&fn) {
+        _pool.parallel_for(_size, grain, std::forward<Function>(fn));
+    }
+
+    private:
+
+    void step_frame(Slot &slot, uint64_t last);
+    void step_group(size_t begin, size_t end, uint32_t frames);
+
+    // Instructions for the next frame of a slot.
+    uint32_t frame_budget(Slot &slot);
+
+    // Account for a run() result, fast forward stops short of the frame count last.
+    // @return false once the frame is over for this slot.
+    bool handle(Slot &slot, const Chip8::RunResult &result, uint32_t &budget, uint64_t last);
+
+    // Run the rest of the frame budget and tick the timers.
+    void finish_frame(Slot &slot, uint32_t budget, uint64_t last);
+
+    tools::utils::ThreadPool _pool;
+    std::unique_ptr<Slot[]> _slots;
+    size_t _size;
+
+    // Mapped by every machine, see load_rom().
+    std::shared_ptr<const RomImage> _image;
+
+    uint32_t _cpu_freq = 1000;
+    bool _fast_forward = false;
+    bool _lockstep = false;
+    std::atomic<uint64_t> _lockstep_count = 0;
+};
+
+} // namespace tools::chip8
+
+#endif // BATCHENGINE_HPP
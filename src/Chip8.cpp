@@ -4,7 +4,11 @@
 #include "spdlog/fmt/bin_to_hex.h"
 
 #include "files.hpp"
+#include "Hash.hpp"
+#include "Jit.hpp"
+#include "Trace.hpp"
 
+#include <bit>
 #include <ctime>
 
 #define V0 _v[0x0]
@@ -24,38 +28,35 @@
 #define VE _v[0xe]
 #define VF _v[0xf]
 
-#define FONTSET_SIZE 80
-const unsigned char fontset[FONTSET_SIZE] = {
-	0xF0, 0x90, 0x90, 0x90, 0xF0,		// 0
-	0x20, 0x60, 0x20, 0x20, 0x70,		// 1
-	0xF0, 0x10, 0xF0, 0x80, 0xF0,		// 2
-	0xF0, 0x10, 0xF0, 0x10, 0xF0,		// 3
-	0x90, 0x90, 0xF0, 0x10, 0x10,		// 4
-	0xF0, 0x80, 0xF0, 0x10, 0xF0,		// 5
-	0xF0, 0x80, 0xF0, 0x90, 0xF0,		// 6
-	0xF0, 0x10, 0x20, 0x40, 0x40,		// 7
-	0xF0, 0x90, 0xF0, 0x90, 0xF0,		// 8
-	0xF0, 0x90, 0xF0, 0x10, 0xF0,		// 9
-	0xF0, 0x90, 0xF0, 0x90, 0x90,		// A
-	0xE0, 0x90, 0xE0, 0x90, 0xE0,		// B
-	0xF0, 0x80, 0x80, 0x80, 0xF0,		// C
-	0xE0, 0x90, 0x90, 0x90, 0xE0,		// D
-	0xF0, 0x80, 0xF0, 0x80, 0xF0,		// E
-	0xF0, 0x80, 0xF0, 0x80, 0x80		// F
+namespace tools::chip8 {
+
+// Indexed by Chip8::Fused.
+const Chip8::FusedHandler Chip8::_fused_handlers[FUSED_COUNT] = {
+    nullptr, // FUSED_NONE
+    &Chip8::fused_set_vx_vy,
+    &Chip8::fused_set_i_draw,
+    &Chip8::fused_wait_delay
 };
 
-namespace tools::chip8 {
+template <uint8_t... Bits>
+constexpr std::array<Chip8::Interpreter, sizeof...(Bits)> Chip8::make_interpreters(std::integer_sequence<uint8_t, Bits...>) {
+    return {{ { &Chip8::run_interpreter<Bits>, &Chip8::decode_execute_quirks<Bits> }... }};
+}
+
+// Indexed by Chip8::quirk_bits().
+const std::array<Chip8::Interpreter, Chip8::QUIRK_COMBINATIONS> Chip8::_interpreters =
+    make_interpreters(std::make_integer_sequence<uint8_t, QUIRK_COMBINATIONS>());
 
 Chip8::Chip8() {
+    _arena = PageArena::shared();
+    _interpreter = &_interpreters[quirk_bits(_quirks)];
     reset();
-    srand(time(nullptr));
-
-    for (int i = 0; i < FONTSET_SIZE; i++) {
-        _memory[i] = fontset[i];
-	}
+    seed(time(nullptr));
 }
 
-Chip8::~Chip8() {}
+Chip8::~Chip8() {
+    release_pages();
+}
 
 void Chip8::reset() {
     // Most chip-8 programs start at 0x200
@@ -66,15 +67,23 @@ void Chip8::reset() {
     _delay_timer = 0;
     _sound_timer = 0;
 
-    _stack.clear();
+    _sp = 0;
+    _instructions = 0;
 
-    _vx = _v;
-    _vy = _v;
-
-    cls();
-    memset(_memory, 0, MEMORY_SIZE);
+    cls({});
     memset(_v, 0, REGISTERS_SIZE);
     memset(_keys, 0, KEYS);
+
+    // Memory only holds the font until a rom is loaded.
+    static const std::shared_ptr<const RomImage> empty = RomImage::create({});
+    load_rom(empty);
+}
+
+void Chip8::seed(uint64_t seed) {
+    // xorshift gets stuck on 0.
+    _rng = mix64(seed);
+    if (_rng == 0)
+        _rng = 1;
 }
 
 bool Chip8::load_rom(const std::string &path) {
@@ -89,41 +98,370 @@ bool Chip8::load_rom(const std::string &path) {
         return false;
     }
 
-    if (rom.size() > (uint16_t)(MEMORY_SIZE - PROGRAM_SIZE)) {
-        SPDLOG_ERROR("Rom '{}' is too large to be loaded into memory. Size is {} bytes.", path, rom.size());
+    return load_rom(rom);
+}
+
+bool Chip8::load_rom(const std::vector<uint8_t> &rom) {
+    std::shared_ptr<const RomImage> image = RomImage::create(rom);
+    if (!image) {
+        SPDLOG_ERROR("Rom is too large to be loaded into memory. Size is {} bytes.", rom.size());
         return false;
     }
 
-    for (uint16_t i = 0 ; i < rom.size() ; ++i)
-        _memory[i + PROGRAM_START] = rom[i];
-
+    load_rom(image);
     return true;
 }
 
+void Chip8::load_rom(std::shared_ptr<const RomImage> image) {
+    release_pages();
+    _image = std::move(image);
+    for (int page = 0 ; page < MEMORY_PAGES ; ++page)
+        _pages[page] = _image->page(page);
+    _memory_hash = _image->get_hash();
+
+    invalidate_all();
+}
+
+void Chip8::set_page_arena(std::shared_ptr<PageArena> arena) {
+    // Copied pages go back to the arena they came from.
+    for (int page = 0 ; page < MEMORY_PAGES ; ++page) {
+        if (!(_owned_pages & (1 << page)))
+            continue;
+
+        Page *copy = arena->allocate();
+        memcpy(copy->bytes, _pages[page], MEMORY_PAGE_SIZE);
+        _arena->release(reinterpret_cast<Page *>(const_cast<uint8_t *>(_pages[page])));
+        _pages[page] = copy->bytes;
+    }
+    _arena = std::move(arena);
+}
+
+void Chip8::copy_state(const Chip8 &other) {
+    if (&other == this)
+        return;
+
+    // Share what other shares with its image, copy what it wrote.
+    release_pages();
+    _image = other._image;
+    for (int page = 0 ; page < MEMORY_PAGES ; ++page) {
+        if (other._owned_pages & (1 << page)) {
+            Page *copy = _arena->allocate();
+            memcpy(copy->bytes, other._pages[page], MEMORY_PAGE_SIZE);
+            _pages[page] = copy->bytes;
+        }
+        else {
+            _pages[page] = other._pages[page];
+        }
+    }
+    _owned_pages = other._owned_pages;
+
+    memcpy(_screen, other._screen, sizeof(_screen));
+    _frame_hash = other._frame_hash;
+    _memory_hash = other._memory_hash;
+    memcpy(_v, other._v, REGISTERS_SIZE);
+    memcpy(_stack, other._stack, sizeof(_stack));
+    memcpy(_keys, other._keys, KEYS);
+    _pc = other._pc;
+    _i = other._i;
+    _sp = other._sp;
+    _delay_timer = other._delay_timer;
+    _sound_timer = other._sound_timer;
+    _rng = other._rng;
+    _instructions = other._instructions;
+
+    invalidate_all();
+}
+
+void Chip8::save_state(State &state) {
+    for (int page = 0 ; page < MEMORY_PAGES ; ++page)
+        memcpy(state.memory + page * MEMORY_PAGE_SIZE, _pages[page], MEMORY_PAGE_SIZE);
+
+    memcpy(state.screen, _screen, sizeof(_screen));
+    memcpy(state.v, _v, REGISTERS_SIZE);
+    memcpy(state.stack, _stack, sizeof(_stack));
+    memcpy(state.keys, _keys, KEYS);
+    state.pc = _pc;
+    state.i = _i;
+    state.sp = _sp;
+    state.delay_timer = _delay_timer;
+    state.sound_timer = _sound_timer;
+    state.rng = _rng;
+    state.instructions = _instructions;
+}
+
+void Chip8::load_state(const State &state) {
+    for (int page = 0 ; page < MEMORY_PAGES ; ++page) {
+        const uint8_t *bytes = state.memory + page * MEMORY_PAGE_SIZE;
+        if (memcmp(_pages[page], bytes, MEMORY_PAGE_SIZE) == 0)
+            continue;
+
+        for (int offset = 0 ; offset < MEMORY_PAGE_SIZE ; offset += 8) {
+            uint64_t before, after;
+            memcpy(&before, _pages[page] + offset, sizeof(before));
+            memcpy(&after, bytes + offset, sizeof(after));
+            if (before == after)
+                continue;
+
+            uint16_t addr = page * MEMORY_PAGE_SIZE + offset;
+            _memory_hash ^= memory_term(addr, before) ^ memory_term(addr, after);
+
+            // Only the bytes that change, the others may hold translated code
+            // that a run-ahead would otherwise retranslate every frame.
+            for (int byte = 0 ; byte < 8 ; ++byte) {
+                if (_pages[page][offset + byte] != bytes[offset + byte])
+                    invalidate(addr + byte);
+            }
+        }
+
+        bool owned = _owned_pages & (1 << page);
+        const uint8_t *shared = _image->page(page);
+
+        if (memcmp(shared, bytes, MEMORY_PAGE_SIZE) == 0) {
+            if (owned)
+                _arena->release(reinterpret_cast<Page *>(const_cast<uint8_t *>(_pages[page])));
+            _pages[page] = shared;
+            _owned_pages &= ~(1 << page);
+        }
+        else {
+            if (!owned) {
+                _pages[page] = _arena->allocate()->bytes;
+                _owned_pages |= 1 << page;
+            }
+            // Owned pages come from the arena and are writable.
+            memcpy(const_cast<uint8_t *>(_pages[page]), bytes, MEMORY_PAGE_SIZE);
+        }
+    }
+
+    for (int y = 0 ; y < HEIGHT ; ++y) {
+        if (_screen[y] != state.screen[y]) {
+            _frame_hash ^= hash_term(y, _screen[y]) ^ hash_term(y, state.screen[y]);
+            _screen[y] = state.screen[y];
+        }
+    }
+    memcpy(_v, state.v, REGISTERS_SIZE);
+    memcpy(_stack, state.stack, sizeof(_stack));
+    memcpy(_keys, state.keys, KEYS);
+    _pc = state.pc & 0x0fff;
+    _i = state.i;
+    _sp = state.sp > STACK_SIZE ? STACK_SIZE : state.sp;
+    _delay_timer = state.delay_timer;
+    _sound_timer = state.sound_timer;
+    _rng = state.rng == 0 ? 1 : state.rng;
+    _instructions = state.instructions;
+}
+
+void Chip8::release_pages() {
+    for (int page = 0 ; page < MEMORY_PAGES ; ++page) {
+        if (_owned_pages & (1 << page))
+            _arena->release(reinterpret_cast<Page *>(const_cast<uint8_t *>(_pages[page])));
+    }
+    _owned_pages = 0;
+}
+
+int Chip8::get_owned_pages() {
+    return std::popcount(_owned_pages);
+}
+
 void Chip8::log_memory(uint16_t length, uint16_t offset) {
     uint16_t l = length == 0 ? MEMORY_SIZE : length;
-    std::vector to_print(_memory + offset, _memory + offset + l);
+    std::vector<uint8_t> to_print(l);
+    for (uint16_t i = 0 ; i < l ; ++i)
+        to_print[i] = read_memory(offset + i);
     SPDLOG_INFO(spdlog::to_hex(to_print));
 }
 
 void Chip8::dump_memory(const std::string &path) {
     if (!path.empty()) {
         std::ofstream file(path, std::ios::binary);
-        file.write(reinterpret_cast<char *>(_memory), MEMORY_SIZE);
+        for (int page = 0 ; page < MEMORY_PAGES ; ++page)
+            file.write(reinterpret_cast<const char *>(_pages[page]), MEMORY_PAGE_SIZE);
     }
 }
 
 void Chip8::log_v() {
-    std::vector to_print(_v, _v + REGISTERS_SIZE);
+    std::span<const uint8_t> to_print(_v, REGISTERS_SIZE);
     SPDLOG_DEBUG("V = {}", spdlog::to_hex(to_print));
 }
 
-const bool *Chip8::get_screen_buffer() {
+const uint64_t *Chip8::get_screen_buffer() {
     return _screen;
 }
 
+void Chip8::unpack_screen(const uint64_t *rows, bool *pixels) {
+    for (int y = 0 ; y < HEIGHT ; ++y) {
+        for (int x = 0 ; x < WIDTH ; ++x)
+            pixels[y * WIDTH + x] = (rows[y] >> (WIDTH - 1 - x)) & 0x1;
+    }
+}
+
+uint64_t Chip8::frame_hash() {
+    return _frame_hash;
+}
+
+uint64_t Chip8::memory_term(uint16_t addr, uint64_t word) {
+    // Positioned after the screen rows.
+    return hash_term(HEIGHT + (addr >> 3), word);
+}
+
+uint64_t Chip8::state_hash() {
+    uint64_t hash = _frame_hash ^ _memory_hash;
+    int position = HEIGHT + MEMORY_SIZE / 8;
+
+    for (int i = 0 ; i < REGISTERS_SIZE ; i += 8) {
+        uint64_t word;
+        memcpy(&word, _v + i, sizeof(word));
+        hash ^= hash_term(position++, word);
+    }
+
+    // Entries above _sp are stale, they do not make states different.
+    for (int i = 0 ; i < _sp ; ++i)
+        hash ^= hash_term(position + i, _stack[i]);
+    position += STACK_SIZE;
+
+    uint64_t registers = _pc | (uint64_t)_i << 16 | (uint64_t)_sp << 32
+        | (uint64_t)_delay_timer << 40 | (uint64_t)_sound_timer << 48;
+    hash ^= hash_term(position++, registers);
+    hash ^= hash_term(position++, _rng);
+    return hash;
+}
+
 void Chip8::next_instruction() {
-    decode_execute(fetch());
+    if (_trace) [[unlikely]]
+        execute_traced();
+    else if (_decoded)
+        execute_predecoded();
+    else
+        decode_execute(fetch());
+}
+
+Chip8::RunResult Chip8::run(uint32_t budget) {
+    uint32_t executed = 0;
+    _event = StopReason::budget;
+
+    if (!_single_step) {
+        if (!_decoded)
+            return (this->*_interpreter->run)(budget);
+        if (!_jit)
+            return run_predecoded(budget);
+    }
+
+    while (executed < budget) {
+        if (_single_step) [[unlikely]] {
+            if (executed > 0 && _breakpoints && (*_breakpoints)[_pc & 0x0fff]) {
+                _instructions += executed;
+                return { executed, StopReason::breakpoint };
+            }
+            // Blocks and fused sequences could step over a breakpoint
+            // and are not traced.
+            next_instruction();
+            ++executed;
+        }
+        else {
+            // Blocks return addresses within memory, a pc past its end runs predecoded.
+            const Jit::Block *block = _pc < MEMORY_SIZE ? _jit->find(_pc, _pages) : nullptr;
+            if (block && block->length <= budget - executed) {
+                // Blocks do not contain instructions raising events.
+                _pc = block->code(_v, &_i);
+                executed += block->length;
+                continue;
+            }
+            // Instructions left out of blocks run from the predecoded table.
+            execute_predecoded();
+            ++executed;
+        }
+
+        if (_event != StopReason::budget) [[unlikely]]
+            break;
+    }
+
+    _instructions += executed;
+    return { executed, _event };
+}
+
+template <uint8_t Bits>
+Chip8::RunResult Chip8::run_interpreter(uint32_t budget) {
+    uint32_t executed = 0;
+
+    while (executed < budget) {
+        decode_execute_quirks<Bits>(fetch());
+        ++executed;
+
+        if (_event != StopReason::budget) [[unlikely]]
+            break;
+    }
+
+    _instructions += executed;
+    return { executed, _event };
+}
+
+Chip8::RunResult Chip8::run_predecoded(uint32_t budget) {
+    uint32_t executed = 0;
+
+    while (executed < budget) {
+        // Looked up once for both the fused sequence and the single instruction.
+        const Instruction &ins = predecoded(_pc);
+        if (ins.fused != FUSED_NONE && budget - executed >= FUSED_MAX_LENGTH) {
+            executed += (this->*_fused_handlers[ins.fused])(&ins);
+        }
+        else {
+            _pc += 2;
+            execute(ins);
+            ++executed;
+        }
+
+        if (_event != StopReason::budget) [[unlikely]]
+            break;
+    }
+
+    _instructions += executed;
+    return { executed, _event };
+}
+
+void Chip8::enable_trace(size_t capacity) {
+    _trace = std::make_unique<Trace>(capacity);
+    update_single_step();
+}
+
+void Chip8::disable_trace() {
+    _trace.reset();
+    update_single_step();
+}
+
+bool Chip8::is_tracing() {
+    return _trace != nullptr;
+}
+
+bool Chip8::dump_trace(const std::string &path) {
+    if (!_trace) {
+        SPDLOG_ERROR("Cannot dump trace, tracing is disabled.");
+        return false;
+    }
+    return _trace->dump(path);
+}
+
+void Chip8::add_breakpoint(uint16_t addr) {
+    if (!_breakpoints)
+        _breakpoints = std::make_unique<std::bitset<MEMORY_SIZE>>();
+    (*_breakpoints)[addr & 0x0fff] = true;
+    update_single_step();
+}
+
+void Chip8::remove_breakpoint(uint16_t addr) {
+    if (!_breakpoints)
+        return;
+    (*_breakpoints)[addr & 0x0fff] = false;
+    if (_breakpoints->none())
+        _breakpoints.reset();
+    update_single_step();
+}
+
+void Chip8::clear_breakpoints() {
+    _breakpoints.reset();
+    update_single_step();
+}
+
+void Chip8::update_single_step() {
+    _single_step = _breakpoints || _trace;
 }
 
 void Chip8::decrease_timers() {
@@ -131,6 +469,67 @@ void Chip8::decrease_timers() {
     if (_sound_timer > 0) --_sound_timer;
 }
 
+void Chip8::set_backend(Backend backend) {
+    _backend = backend;
+
+    // The JIT runs the instructions it does not translate from the predecoded table.
+    bool decoded = _backend == Backend::predecoded || _backend == Backend::jit;
+    if (decoded && !_decoded) {
+        _decoded = std::make_unique<Instruction[]>(MEMORY_SIZE);
+        invalidate_all();
+    }
+    else if (!decoded) {
+        _decoded.reset();
+    }
+
+    if (_backend == Backend::jit && !_jit) {
+        _jit = std::make_unique<Jit>();
+        if (!_jit->is_available())
+            _jit.reset();
+        else
+            _jit->set_quirks(_quirks);
+    }
+    else if (_backend != Backend::jit) {
+        _jit.reset();
+    }
+}
+
+Chip8::Backend Chip8::get_backend() {
+    return _backend;
+}
+
+void Chip8::set_quirks(const Quirks &quirks) {
+    _quirks = quirks;
+    _interpreter = &_interpreters[quirk_bits(_quirks)];
+
+    // Decoded handlers and translated blocks depend on the quirks.
+    if (_jit)
+        _jit->set_quirks(_quirks);
+    invalidate_all();
+}
+
+const Quirks &Chip8::get_quirks() {
+    return _quirks;
+}
+
+bool Chip8::set_quirks_profile(const std::string &name) {
+    auto quirks = quirks_from_profile(name);
+    if (!quirks) {
+        SPDLOG_ERROR("Unknown quirks profile '{}'.", name);
+        return false;
+    }
+
+    set_quirks(*quirks);
+    return true;
+}
+
+uint8_t Chip8::fast_forward_timers(uint8_t max_ticks) {
+    uint8_t ticks = _delay_timer < max_ticks ? _delay_timer : max_ticks;
+    _delay_timer -= ticks;
+    _sound_timer = _sound_timer > ticks ? _sound_timer - ticks : 0;
+    return ticks;
+}
+
 void Chip8::key_pressed(uint8_t key) {
     _keys[key] = 1;
 }
@@ -139,8 +538,24 @@ void Chip8::key_released(uint8_t key) {
     _keys[key] = 0;
 }
 
-const uint8_t  *Chip8::get_memory() {
-    return _memory;
+void Chip8::set_keys(uint16_t keys) {
+    for (int key = 0 ; key < KEYS ; ++key)
+        _keys[key] = (keys >> key) & 0x1;
+}
+
+uint16_t Chip8::get_key_mask() {
+    uint16_t keys = 0;
+    for (int key = 0 ; key < KEYS ; ++key)
+        keys |= (_keys[key] & 0x1) << key;
+    return keys;
+}
+
+uint64_t Chip8::get_instructions() {
+    return _instructions;
+}
+
+uint8_t Chip8::get_memory(uint16_t addr) {
+    return read_memory(addr);
 }
 
 const uint8_t *Chip8::get_v() {
@@ -155,8 +570,8 @@ uint16_t Chip8::get_i() {
     return _i;
 }
 
-std::vector<uint16_t> Chip8::get_stack() {
-    return _stack;
+std::span<const uint16_t> Chip8::get_stack() {
+    return { _stack, _sp };
 }
 
 uint8_t Chip8::get_delay_timer() {
@@ -182,261 +597,520 @@ int8_t Chip8::get_pressed_key() {
 uint16_t Chip8::fetch() {
     // Memory is 8 bits but instructions are 16 bits.
     // So we assemble data from memory at _pc and _pc + 1.
-    uint16_t opcode = (_memory[_pc] << 8) | _memory[_pc + 1];
-    SPDLOG_DEBUG("Fetched opcode 0x{:X} at PC = 0x{:03X} (0x{:03X})", opcode, _pc, _pc - 0x200);
+    uint16_t opcode = (read_memory(_pc) << 8) | read_memory(_pc + 1);
 
     // Increase pc to next instruction.
     _pc += 2;
     return opcode;
 }
 
+uint8_t Chip8::quirk_bits(const Quirks &quirks) {
+    return (quirks.shift_vy ? QUIRK_SHIFT_VY : 0)
+        | (quirks.increment_i ? QUIRK_INCREMENT_I : 0)
+        | (quirks.vf_reset ? QUIRK_VF_RESET : 0)
+        | (quirks.clip ? QUIRK_CLIP : 0)
+        | (quirks.jump_vx ? QUIRK_JUMP_VX : 0);
+}
+
 void Chip8::decode_execute(uint16_t opcode) {
-    _msb    = (opcode >> 12) & 0x000f;
-    _addr   = opcode & 0x0fff;
-    _const8 = opcode & 0x00ff;
-    _const4 = opcode & 0x000f;
-
-    _x = (opcode >> 8) & 0x000f;
-    _y = (opcode >> 4) & 0x000f;
-    _vx = _v + _x;
-    _vy = _v + _y;
-
-    SPDLOG_DEBUG("msb = 0x{:X}\taddr = 0x{:03X}\t8 lsb = 0x{:02X}\t4 lsb = 0x{:X}\tVX = 0x{:X}\tVY = 0x{:X}", _msb, _addr, _const8, _const4, *_vx, *_vy);
-
-    switch (_msb) {
-        case 0x0: decode_op_0();    break;
-        case 0x1: jump();           break;
-        case 0x2: call();           break;
-        case 0x3: skip_eq();        break;
-        case 0x4: skip_neq();       break;
-        case 0x5: skip_eq_x_y();    break;
-        case 0x6: set_vx();         break;
-        case 0x7: add_to_vx();      break;
-        case 0x8: decode_op_8();    break;
-        case 0x9: skip_neq_x_y();   break;
-        case 0xa: set_i();          break;
-        case 0xb: jump_v0();        break;
-        case 0xc: rand_and();       break;
-        case 0xd: draw();           break;
-        case 0xe: decode_op_e();    break;
-        case 0xf: decode_op_f();    break;
+    (this->*_interpreter->decode_execute)(opcode);
+}
+
+template <uint8_t Bits>
+void Chip8::decode_execute_quirks(uint16_t opcode) {
+    const Instruction ins = decode_operands(opcode);
+
+    switch (opcode >> 12) {
+        case 0x0: decode_op_0(ins);     break;
+        case 0x1: jump(ins);            break;
+        case 0x2: call(ins);            break;
+        case 0x3: skip_eq(ins);         break;
+        case 0x4: skip_neq(ins);        break;
+        case 0x5: skip_eq_x_y(ins);     break;
+        case 0x6: set_vx(ins);          break;
+        case 0x7: add_to_vx(ins);       break;
+        case 0x8: decode_op_8<Bits>(ins);   break;
+        case 0x9: skip_neq_x_y(ins);    break;
+        case 0xa: set_i(ins);           break;
+        case 0xb: jump_v0<(Bits & QUIRK_JUMP_VX) != 0>(ins); break;
+        case 0xc: rand_and(ins);        break;
+        case 0xd: draw<(Bits & QUIRK_CLIP) != 0>(ins); break;
+        case 0xe: decode_op_e(ins);     break;
+        case 0xf: decode_op_f<Bits>(ins);   break;
         default: break;
     }
 }
 
-void Chip8::decode_op_0() {
-    switch (_const8) {
-        case 0xe0: cls(); break;
-        case 0xee: ret(); break;
-        default: break;
+Chip8::Instruction Chip8::decode_operands(uint16_t opcode) {
+    Instruction ins;
+    ins.op     = OP_UNDECODED;
+    ins.fused  = FUSED_NONE;
+    ins.x      = (opcode >> 8) & 0x000f;
+    ins.y      = (opcode >> 4) & 0x000f;
+    ins.const8 = opcode & 0x00ff;
+    ins.const4 = opcode & 0x000f;
+    ins.addr   = opcode & 0x0fff;
+    return ins;
+}
+
+uint8_t Chip8::decode(uint16_t opcode) {
+    // Resolved once per address so handlers do not test quirks.
+    switch (opcode >> 12) {
+        case 0x0:
+            switch (opcode & 0x00ff) {
+                case 0xe0: return OP_CLS;
+                case 0xee: return OP_RET;
+                default: return OP_NOP;
+            }
+        case 0x1: return OP_JUMP;
+        case 0x2: return OP_CALL;
+        case 0x3: return OP_SKIP_EQ;
+        case 0x4: return OP_SKIP_NEQ;
+        case 0x5: return OP_SKIP_EQ_X_Y;
+        case 0x6: return OP_SET_VX;
+        case 0x7: return OP_ADD_TO_VX;
+        case 0x8:
+            switch (opcode & 0x000f) {
+                case 0x0: return OP_VX_TO_VY;
+                case 0x1: return _quirks.vf_reset ? OP_VX_OR_VY_RESET_VF : OP_VX_OR_VY;
+                case 0x2: return _quirks.vf_reset ? OP_VX_AND_VY_RESET_VF : OP_VX_AND_VY;
+                case 0x3: return _quirks.vf_reset ? OP_VX_XOR_VY_RESET_VF : OP_VX_XOR_VY;
+                case 0x4: return OP_ADD_VY_TO_VX;
+                case 0x5: return OP_SUB_VY_TO_VX;
+                case 0x6: return _quirks.shift_vy ? OP_SHIFT_VY_RIGHT : OP_SHIFT_VX_RIGHT;
+                case 0x7: return OP_VY_MINUS_VX;
+                case 0xe: return _quirks.shift_vy ? OP_SHIFT_VY_LEFT : OP_SHIFT_VX_LEFT;
+                default: return OP_NOP;
+            }
+        case 0x9: return OP_SKIP_NEQ_X_Y;
+        case 0xa: return OP_SET_I;
+        case 0xb: return _quirks.jump_vx ? OP_JUMP_VX : OP_JUMP_V0;
+        case 0xc: return OP_RAND_AND;
+        case 0xd: return _quirks.clip ? OP_DRAW_CLIP : OP_DRAW;
+        case 0xe:
+            switch (opcode & 0x00ff) {
+                case 0x9e: return OP_SKIP_KEY_EQ;
+                case 0xa1: return OP_SKIP_KEY_NEQ;
+                default: return OP_NOP;
+            }
+        case 0xf:
+            switch (opcode & 0x00ff) {
+                case 0x07: return OP_GET_DELAY;
+                case 0x0a: return OP_GET_KEY;
+                case 0x15: return OP_SET_DELAY_TIMER;
+                case 0x18: return OP_SET_SOUND_TIMER;
+                case 0x1e: return OP_ADD_TO_I;
+                case 0x29: return OP_SET_I_TO_CHAR;
+                case 0x33: return OP_STORE_DECIMAL;
+                case 0x55: return _quirks.increment_i ? OP_DUMP_V : OP_DUMP_V_KEEP_I;
+                case 0x65: return _quirks.increment_i ? OP_LOAD_V : OP_LOAD_V_KEEP_I;
+                default: return OP_NOP;
+            }
+        default: return OP_NOP;
     }
 }
 
-void Chip8::cls() {
-    SPDLOG_DEBUG("Clear screen");
-    memset(_screen, 0, SCREEN_SIZE);
+uint16_t Chip8::read_opcode(uint16_t addr) {
+    return (read_memory(addr) << 8) | read_memory(addr + 1);
 }
 
-void Chip8::ret() {
-    SPDLOG_DEBUG("Return");
-    _pc = _stack.back();
-    _stack.pop_back();
-    SPDLOG_DEBUG("PC = 0x{:X}", _pc);
+uint8_t Chip8::read_memory(uint16_t addr) {
+    return _pages[(addr >> 8) & 0x0f][addr & 0xff];
 }
 
-void Chip8::jump() {
-    SPDLOG_DEBUG("Jump");
-    _pc = _addr;
-    SPDLOG_DEBUG("PC = 0x{:X}", _pc);
+void Chip8::write_memory(uint16_t addr, uint8_t value) {
+    addr &= 0x0fff;
+    int page = addr >> 8;
+
+    if (!(_owned_pages & (1 << page))) [[unlikely]] {
+        Page *copy = _arena->allocate();
+        memcpy(copy->bytes, _pages[page], MEMORY_PAGE_SIZE);
+        _pages[page] = copy->bytes;
+        _owned_pages |= 1 << page;
+    }
+
+    // Owned pages come from the arena and are writable.
+    uint8_t *word = const_cast<uint8_t *>(_pages[page]) + (addr & 0xf8);
+    uint64_t before, after;
+    memcpy(&before, word, sizeof(before));
+    word[addr & 0x07] = value;
+    memcpy(&after, word, sizeof(after));
+
+    // Replace the term of the word in the hash.
+    if (before != after)
+        _memory_hash ^= memory_term(addr, before) ^ memory_term(addr, after);
+    invalidate(addr);
 }
 
-void Chip8::call() {
-    SPDLOG_DEBUG("Call");
-    _stack.push_back(_pc);
-    _pc = _addr;
-    SPDLOG_DEBUG("PC = 0x{:X}", _pc);
+void Chip8::predecode(uint16_t addr) {
+    predecode_operands(addr);
+    _decoded[addr].fused = predecode_fused(addr);
 }
 
-void Chip8::skip_eq() {
-    SPDLOG_DEBUG("Skip eq");
-    SPDLOG_DEBUG("Comparing vx (0x{:X}) and const8 (0x{:X})", *_vx, _const8);
-    if (*_vx == _const8)
-        _pc += 2;
-    SPDLOG_DEBUG("pc = 0x{:X}", _pc);
+void Chip8::predecode_operands(uint16_t addr) {
+    uint16_t opcode = read_opcode(addr);
+
+    Instruction &ins = _decoded[addr];
+    ins = decode_operands(opcode);
+    ins.op = decode(opcode);
 }
 
-void Chip8::skip_neq() {
-    SPDLOG_DEBUG("Skip neq");
-    SPDLOG_DEBUG("Comparing vx (0x{:X}) and const8 (0x{:X})", *_vx, _const8);
-    if (*_vx != _const8)
-        _pc += 2;
-    SPDLOG_DEBUG("pc = 0x{:X}", _pc);
+bool Chip8::is_delay_wait_loop(uint16_t addr) {
+    uint16_t first = read_opcode(addr);
+    return (first & 0xf0ff) == 0xf007
+        && read_opcode(addr + 2) == (0x3000 | (first & 0x0f00))
+        && read_opcode(addr + 4) == (0x1000 | (addr & 0x0fff));
 }
 
-void Chip8::skip_eq_x_y() {
-    SPDLOG_DEBUG("Skip eq x y");
-    SPDLOG_DEBUG("Comparing vx (0x{:X}) and vy (0x{:X})", *_vx, *_vy);
-    if (*_vx == *_vy)
-        _pc += 2;
-    SPDLOG_DEBUG("pc = 0x{:X}", _pc);
+uint8_t Chip8::predecode_fused(uint16_t addr) {
+    // Sequences do not wrap around the end of memory
+    // since fused handlers read the following entries directly.
+    if (addr + 2 * FUSED_MAX_LENGTH > MEMORY_SIZE)
+        return FUSED_NONE;
+
+    uint16_t first = read_opcode(addr);
+    uint16_t second = read_opcode(addr + 2);
+
+    uint8_t fused = FUSED_NONE;
+    if ((first & 0xf000) == 0x6000 && (second & 0xf000) == 0x6000) {
+        fused = FUSED_SET_VX_VY;
+    }
+    else if ((first & 0xf000) == 0xa000 && (second & 0xf000) == 0xd000) {
+        fused = FUSED_SET_I_DRAW;
+    }
+    else if (is_delay_wait_loop(addr)) {
+        fused = FUSED_WAIT_DELAY;
+    }
+    else {
+        return FUSED_NONE;
+    }
+
+    // Fused handlers read the operands of the following instructions.
+    for (uint16_t next = addr + 2 ; next < addr + 2 * FUSED_MAX_LENGTH ; next += 2) {
+        if (_decoded[next].op == OP_UNDECODED)
+            predecode_operands(next);
+    }
+
+    return fused;
 }
 
-void Chip8::set_vx() {
-    SPDLOG_DEBUG("Set vx");
-    *_vx = _const8;
+Chip8::Instruction &Chip8::predecoded(uint16_t addr) {
+    addr &= 0x0fff;
+    Instruction &ins = _decoded[addr];
+    if (ins.op == OP_UNDECODED) [[unlikely]]
+        predecode(addr);
+    return ins;
+}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+void Chip8::execute_predecoded() {
+    const Instruction &ins = predecoded(_pc);
+    _pc += 2;
+    execute(ins);
 }
 
-void Chip8::add_to_vx() {
-    SPDLOG_DEBUG("Add to vx");
-    *_vx += _const8;
+void Chip8::execute(const Instruction &ins) {
+    // A switch rather than a table of member pointers, so that handlers are inlined.
+    switch (ins.op) {
+        case OP_CLS:                cls(ins);                       break;
+        case OP_RET:                ret(ins);                       break;
+        case OP_JUMP:               jump(ins);                      break;
+        case OP_CALL:               call(ins);                      break;
+        case OP_SKIP_EQ:            skip_eq(ins);                   break;
+        case OP_SKIP_NEQ:           skip_neq(ins);                  break;
+        case OP_SKIP_EQ_X_Y:        skip_eq_x_y(ins);               break;
+        case OP_SET_VX:             set_vx(ins);                    break;
+        case OP_ADD_TO_VX:          add_to_vx(ins);                 break;
+        case OP_VX_TO_VY:           vx_to_vy(ins);                  break;
+        case OP_VX_OR_VY:           vx_or_vy<false>(ins);           break;
+        case OP_VX_AND_VY:          vx_and_vy<false>(ins);          break;
+        case OP_VX_XOR_VY:          vx_xor_vy<false>(ins);          break;
+        case OP_VX_OR_VY_RESET_VF:  vx_or_vy<true>(ins);            break;
+        case OP_VX_AND_VY_RESET_VF: vx_and_vy<true>(ins);           break;
+        case OP_VX_XOR_VY_RESET_VF: vx_xor_vy<true>(ins);           break;
+        case OP_ADD_VY_TO_VX:       add_vy_to_vx(ins);              break;
+        case OP_SUB_VY_TO_VX:       sub_vy_to_vx(ins);              break;
+        case OP_SHIFT_VX_RIGHT:     shift_vx_right<false>(ins);     break;
+        case OP_VY_MINUS_VX:        vy_minus_vx(ins);               break;
+        case OP_SHIFT_VX_LEFT:      shift_vx_left<false>(ins);      break;
+        case OP_SHIFT_VY_RIGHT:     shift_vx_right<true>(ins);      break;
+        case OP_SHIFT_VY_LEFT:      shift_vx_left<true>(ins);       break;
+        case OP_SKIP_NEQ_X_Y:       skip_neq_x_y(ins);              break;
+        case OP_SET_I:              set_i(ins);                     break;
+        case OP_JUMP_V0:            jump_v0<false>(ins);            break;
+        case OP_JUMP_VX:            jump_v0<true>(ins);             break;
+        case OP_RAND_AND:           rand_and(ins);                  break;
+        case OP_DRAW:               draw<false>(ins);               break;
+        case OP_DRAW_CLIP:          draw<true>(ins);                break;
+        case OP_SKIP_KEY_EQ:        skip_key_eq(ins);               break;
+        case OP_SKIP_KEY_NEQ:       skip_key_neq(ins);              break;
+        case OP_GET_DELAY:          get_delay(ins);                 break;
+        case OP_GET_KEY:            get_key(ins);                   break;
+        case OP_SET_DELAY_TIMER:    set_delay_timer(ins);           break;
+        case OP_SET_SOUND_TIMER:    set_sound_timer(ins);           break;
+        case OP_ADD_TO_I:           add_to_i(ins);                  break;
+        case OP_SET_I_TO_CHAR:      set_i_to_char(ins);             break;
+        case OP_STORE_DECIMAL:      store_decimal(ins);             break;
+        case OP_DUMP_V:             dump_v<true>(ins);              break;
+        case OP_LOAD_V:             load_v<true>(ins);              break;
+        case OP_DUMP_V_KEEP_I:      dump_v<false>(ins);             break;
+        case OP_LOAD_V_KEEP_I:      load_v<false>(ins);             break;
+        default:                    nop(ins);                       break;
+    }
+}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+uint8_t Chip8::fused_set_vx_vy(const Instruction *ins) {
+    _v[ins[0].x] = ins[0].const8;
+    _v[ins[2].x] = ins[2].const8;
+    _pc += 4;
+    return 2;
 }
 
-void Chip8::decode_op_8() {
-    switch (_const4) {
-        case 0x0: vx_to_vy();         break;
-        case 0x1: vx_or_vy();         break;
-        case 0x2: vx_and_vy();        break;
-        case 0x3: vx_xor_vy();        break;
-        case 0x4: add_vy_to_vx();     break;
-        case 0x5: sub_vy_to_vx();     break;
-        case 0x6: shift_vx_right();   break;
-        case 0x7: vy_minus_vx();      break;
-        case 0xe: shift_vx_left();    break;
-        default: break;
+uint8_t Chip8::fused_set_i_draw(const Instruction *ins) {
+    _i = ins[0].addr;
+    _pc += 4;
+    execute(ins[2]);
+    return 2;
+}
+
+uint8_t Chip8::fused_wait_delay(const Instruction *ins) {
+    // Fx07 then 3x00 skips the jump back once the timer is over.
+    uint8_t x = ins[0].x;
+    _v[x] = _delay_timer;
+    if (_v[x] == 0) {
+        _pc += 6;
+        return 2;
     }
+    _event = StopReason::idle;
+    return 3;
 }
 
-void Chip8::vx_to_vy() {
-    SPDLOG_DEBUG("assign vy to vx");
-    *_vx = *_vy;
+void Chip8::execute_traced() {
+    uint16_t pc = _pc;
+    uint16_t opcode = read_opcode(pc);
+
+    if (_decoded)
+        execute_predecoded();
+    else
+        decode_execute(fetch());
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+    uint8_t x = (opcode >> 8) & 0x000f;
+    _trace->record({ pc, opcode, _i, x, _v[x] });
 }
 
-void Chip8::vx_or_vy() {
-    SPDLOG_DEBUG("vx |= vy");
-    *_vx |= *_vy;
+void Chip8::invalidate(uint16_t addr) {
+    if (_jit)
+        _jit->invalidate(addr);
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+    if (!_decoded)
+        return;
+
+    // An instruction spans its own address and the next one,
+    // fused sequences span up to FUSED_MAX_LENGTH instructions.
+    for (uint16_t i = 0 ; i < 2 * FUSED_MAX_LENGTH ; ++i)
+        _decoded[(addr - i) & 0x0fff].op = OP_UNDECODED;
 }
 
-void Chip8::vx_and_vy() {
-    SPDLOG_DEBUG("vx &= vy");
-    *_vx &= *_vy;
+void Chip8::invalidate_all() {
+    if (_jit)
+        _jit->flush();
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+    if (_decoded)
+        memset(_decoded.get(), 0, MEMORY_SIZE * sizeof(Instruction));
 }
 
-void Chip8::vx_xor_vy() {
-    SPDLOG_DEBUG("vx ^= vy");
-    *_vx ^= *_vy;
+void Chip8::nop(const Instruction &) {}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+void Chip8::decode_op_0(const Instruction &ins) {
+    switch (ins.const8) {
+        case 0xe0: cls(ins); break;
+        case 0xee: ret(ins); break;
+        default: break;
+    }
 }
 
-void Chip8::add_vy_to_vx() {
-    SPDLOG_DEBUG("add vy to vx");
-    _tmp = *_vx + *_vy;
-    VF = _tmp > 0xff ? 1 : 0;
-    *_vx = _tmp;
+void Chip8::cls(const Instruction &) {
+    static const uint64_t empty_hash = [] {
+        uint64_t hash = 0;
+        for (int y = 0 ; y < HEIGHT ; ++y)
+            hash ^= hash_term(y, 0);
+        return hash;
+    }();
+
+    memset(_screen, 0, sizeof(_screen));
+    _frame_hash = empty_hash;
+    _event = StopReason::frame_drawn;
+}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+void Chip8::ret(const Instruction &) {
+    if (_sp == 0) {
+        _event = StopReason::stack_fault;
+        return;
+    }
+    _pc = _stack[--_sp];
 }
 
-void Chip8::sub_vy_to_vx() {
-    SPDLOG_DEBUG("sub vy to vx");
-    VF = *_vy > *_vx ? 0 : 1;
-    *_vx -= *_vy;
+void Chip8::jump(const Instruction &ins) {
+    if (ins.addr == _pc - 2)
+        _event = StopReason::halt_loop;
+    else if (ins.addr == _pc - 6 && is_delay_wait_loop(ins.addr))
+        _event = StopReason::idle;
+    _pc = ins.addr;
+}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+void Chip8::call(const Instruction &ins) {
+    if (_sp == STACK_SIZE) {
+        _event = StopReason::stack_fault;
+        return;
+    }
+    _stack[_sp++] = _pc;
+    _pc = ins.addr;
 }
 
-void Chip8::shift_vx_right() {
-    SPDLOG_DEBUG("shift vx right");
-    VF = *_vx & 0x1;
-    *_vx >>= 1;
+void Chip8::skip_eq(const Instruction &ins) {
+    if (_v[ins.x] == ins.const8)
+        _pc += 2;
+}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+void Chip8::skip_neq(const Instruction &ins) {
+    if (_v[ins.x] != ins.const8)
+        _pc += 2;
 }
 
-void Chip8::vy_minus_vx() {
-    SPDLOG_DEBUG("vy - vx");
-    VF = *_vx > *_vy ? 0 : 1;
-    *_vx = *_vy - *_vx;
+void Chip8::skip_eq_x_y(const Instruction &ins) {
+    if (_v[ins.x] == _v[ins.y])
+        _pc += 2;
+}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+void Chip8::set_vx(const Instruction &ins) {
+    _v[ins.x] = ins.const8;
 }
 
-void Chip8::shift_vx_left() {
-    SPDLOG_DEBUG("shift vx left");
-    VF = (*_vx >> 7) & 0x1;
-    *_vx <<= 1;
+void Chip8::add_to_vx(const Instruction &ins) {
+    _v[ins.x] += ins.const8;
 }
 
-void Chip8::skip_neq_x_y() {
-    SPDLOG_DEBUG("skip neq x y");
-    if (*_vx != *_vy) _pc += 2;
+template <uint8_t Bits>
+void Chip8::decode_op_8(const Instruction &ins) {
+    constexpr bool reset_vf = (Bits & QUIRK_VF_RESET) != 0;
+    constexpr bool shift_vy = (Bits & QUIRK_SHIFT_VY) != 0;
+
+    switch (ins.const4) {
+        case 0x0: vx_to_vy(ins);                    break;
+        case 0x1: vx_or_vy<reset_vf>(ins);          break;
+        case 0x2: vx_and_vy<reset_vf>(ins);         break;
+        case 0x3: vx_xor_vy<reset_vf>(ins);         break;
+        case 0x4: add_vy_to_vx(ins);                break;
+        case 0x5: sub_vy_to_vx(ins);                break;
+        case 0x6: shift_vx_right<shift_vy>(ins);    break;
+        case 0x7: vy_minus_vx(ins);                 break;
+        case 0xe: shift_vx_left<shift_vy>(ins);     break;
+        default: break;
+    }
 }
 
-void Chip8::set_i() {
-    SPDLOG_DEBUG("set I");
-    _i = _addr;
-    SPDLOG_DEBUG("I = 0x{:04X}", _i);
+void Chip8::vx_to_vy(const Instruction &ins) {
+    _v[ins.x] = _v[ins.y];
 }
 
-void Chip8::jump_v0() {
-    SPDLOG_DEBUG("jump to VO + addr");
-    _pc = V0 + _addr;
+template <bool ResetVf>
+void Chip8::vx_or_vy(const Instruction &ins) {
+    _v[ins.x] |= _v[ins.y];
+    if constexpr (ResetVf)
+        VF = 0;
 }
 
-void Chip8::rand_and() {
-    SPDLOG_DEBUG("rand and");
-    _random = rand();
-    *_vx = _random & _const8;
+template <bool ResetVf>
+void Chip8::vx_and_vy(const Instruction &ins) {
+    _v[ins.x] &= _v[ins.y];
+    if constexpr (ResetVf)
+        VF = 0;
+}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+template <bool ResetVf>
+void Chip8::vx_xor_vy(const Instruction &ins) {
+    _v[ins.x] ^= _v[ins.y];
+    if constexpr (ResetVf)
+        VF = 0;
 }
 
-void Chip8::draw() {
-    SPDLOG_DEBUG("draw");
-    SPDLOG_DEBUG("Sprite is {} rows high.", _const4);
-    SPDLOG_DEBUG("Drawing a total of {} pixels.", 8 * _const4);
+void Chip8::add_vy_to_vx(const Instruction &ins) {
+    _tmp = _v[ins.x] + _v[ins.y];
+    VF = _tmp > 0xff ? 1 : 0;
+    _v[ins.x] = _tmp;
+}
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+void Chip8::sub_vy_to_vx(const Instruction &ins) {
+    VF = _v[ins.y] > _v[ins.x] ? 0 : 1;
+    _v[ins.x] -= _v[ins.y];
+}
 
-    VF = 0;
+template <bool ShiftVy>
+void Chip8::shift_vx_right(const Instruction &ins) {
+    if constexpr (ShiftVy) {
+        uint8_t vy = _v[ins.y];
+        VF = vy & 0x1;
+        _v[ins.x] = vy >> 1;
+    }
+    else {
+        VF = _v[ins.x] & 0x1;
+        _v[ins.x] >>= 1;
+    }
+}
+
+void Chip8::vy_minus_vx(const Instruction &ins) {
+    VF = _v[ins.x] > _v[ins.y] ? 0 : 1;
+    _v[ins.x] = _v[ins.y] - _v[ins.x];
+}
+
+template <bool ShiftVy>
+void Chip8::shift_vx_left(const Instruction &ins) {
+    if constexpr (ShiftVy) {
+        uint8_t vy = _v[ins.y];
+        VF = (vy >> 7) & 0x1;
+        _v[ins.x] = vy << 1;
+    }
+    else {
+        VF = (_v[ins.x] >> 7) & 0x1;
+        _v[ins.x] <<= 1;
+    }
+}
+
+void Chip8::skip_neq_x_y(const Instruction &ins) {
+    if (_v[ins.x] != _v[ins.y]) _pc += 2;
+}
+
+void Chip8::set_i(const Instruction &ins) {
+    _i = ins.addr;
+}
 
-    SPDLOG_DEBUG("vx = {}, vy = {}", *_vx, *_vy);
+template <bool JumpVx>
+void Chip8::jump_v0(const Instruction &ins) {
+    if constexpr (JumpVx) {
+        _pc = _v[ins.x] + ins.addr;
+    }
+    else {
+        _pc = V0 + ins.addr;
+    }
+}
 
-    uint8_t mask = 0;
+void Chip8::rand_and(const Instruction &ins) {
+    _random = next_random();
+    _v[ins.x] = _random & ins.const8;
+}
+
+uint8_t Chip8::next_random() {
+    _rng ^= _rng >> 12;
+    _rng ^= _rng << 25;
+    _rng ^= _rng >> 27;
+    return (_rng * 0x2545f4914f6cdd1dull) >> 56;
+}
+
+template <bool Clip>
+void Chip8::draw(const Instruction &ins) {
+    // Coordinates are read before VF is cleared.
+    uint8_t x = _v[ins.x] % WIDTH;
+    uint8_t y = _v[ins.y] % HEIGHT;
+    VF = 0;
 
     // A sprite is 8 pixels wide
     // and N_const4 pixels high.
@@ -445,128 +1119,137 @@ void Chip8::draw() {
     // at a different address starting from _i.
 
     // Iterate over sprite's lines.
-    for (uint8_t ysprite = 0 ; ysprite < _const4 ; ++ysprite) {
-        // Each line is represented by a byte.
-        uint8_t line = _memory[_i + ysprite];
-
-        // Iterate over pixels in current sprite's line.
-        for (int xsprite = 0 ; xsprite < 8 ; ++xsprite) {
-            mask = 1 << (7 - xsprite);
-            // If the selected bit in the line is 1
-            if ((line & mask) != 0) {
-                // Get pixel coords on screen.
-                uint8_t x = (*_vx + xsprite) % WIDTH;
-                uint8_t y = (*_vy + ysprite) % HEIGHT;
-                uint16_t screen_coords = y * WIDTH + x;
-
-                // If the pixel is set to 0, raise VF.
-                if (_screen[screen_coords] == 1)
-                    VF = 1;
-
-                // Toggle the bit.
-                _screen[screen_coords] ^= 1;
-            }
+    for (uint8_t ysprite = 0 ; ysprite < ins.const4 ; ++ysprite) {
+        uint8_t row_index;
+        if constexpr (Clip) {
+            row_index = y + ysprite;
+            if (row_index >= HEIGHT)
+                break;
+        }
+        else {
+            row_index = (y + ysprite) % HEIGHT;
         }
+
+        // Each line is represented by a byte,
+        // moved to the leftmost pixels of a row then to x.
+        uint64_t line = static_cast<uint64_t>(read_memory(_i + ysprite)) << (WIDTH - 8);
+        if constexpr (Clip)
+            line >>= x;
+        else
+            line = std::rotr(line, x);
+
+        uint64_t &row = _screen[row_index];
+        if (!line)
+            continue;
+
+        // If a pixel is turned off, raise VF.
+        if (row & line)
+            VF = 1;
+
+        // Toggle the bits, replacing the term of the row in the hash.
+        _frame_hash ^= hash_term(row_index, row);
+        row ^= line;
+        _frame_hash ^= hash_term(row_index, row);
     }
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+    _event = StopReason::frame_drawn;
 }
 
-void Chip8::decode_op_e() {
-    switch (_const8) {
-        case 0x9e: skip_key_eq();   break;
-        case 0xa1: skip_key_neq();  break;
+void Chip8::decode_op_e(const Instruction &ins) {
+    switch (ins.const8) {
+        case 0x9e: skip_key_eq(ins);    break;
+        case 0xa1: skip_key_neq(ins);   break;
         default: break;
     }
 }
 
-void Chip8::skip_key_eq() {
-    SPDLOG_DEBUG("skip key eq");
-    if (_keys[*_vx]) _pc += 2;
+// Only the low nibble of VX names a key.
+void Chip8::skip_key_eq(const Instruction &ins) {
+    if (_keys[_v[ins.x] & 0x0f]) _pc += 2;
 }
 
-void Chip8::skip_key_neq() {
-    SPDLOG_DEBUG("skpi key neq");
-    if (!_keys[*_vx]) _pc += 2;
+void Chip8::skip_key_neq(const Instruction &ins) {
+    if (!_keys[_v[ins.x] & 0x0f]) _pc += 2;
 }
 
-void Chip8::decode_op_f() {
-    switch (_const8) {
-        case 0x07: get_delay();         break;
-        case 0x0a: get_key();           break;
-        case 0x15: set_delay_timer();   break;
-        case 0x18: set_sound_timer();   break;
-        case 0x1e: add_to_i();          break;
-        case 0x29: set_i_to_char();     break;
-        case 0x33: store_decimal();     break;
-        case 0x55: dump_v();            break;
-        case 0x65: load_v();            break;
+template <uint8_t Bits>
+void Chip8::decode_op_f(const Instruction &ins) {
+    constexpr bool increment_i = (Bits & QUIRK_INCREMENT_I) != 0;
+
+    switch (ins.const8) {
+        case 0x07: get_delay(ins);             break;
+        case 0x0a: get_key(ins);               break;
+        case 0x15: set_delay_timer(ins);       break;
+        case 0x18: set_sound_timer(ins);       break;
+        case 0x1e: add_to_i(ins);              break;
+        case 0x29: set_i_to_char(ins);         break;
+        case 0x33: store_decimal(ins);         break;
+        case 0x55: dump_v<increment_i>(ins);   break;
+        case 0x65: load_v<increment_i>(ins);   break;
         default: break;
     }
 }
 
-void Chip8::get_delay() {
-    SPDLOG_DEBUG("get delay timer");
-    *_vx = _delay_timer;
+void Chip8::get_delay(const Instruction &ins) {
+    _v[ins.x] = _delay_timer;
 }
 
-void Chip8::get_key() {
-    SPDLOG_DEBUG("get key");
+void Chip8::get_key(const Instruction &ins) {
     int8_t pressed_key = get_pressed_key();
-    if (pressed_key == -1)
+    if (pressed_key == -1) {
         _pc -= 2;
+        _event = StopReason::waiting_for_key;
+    }
     else
-        *_vx = pressed_key;
+        _v[ins.x] = pressed_key;
 }
 
-void Chip8::set_delay_timer() {
-    SPDLOG_DEBUG("set delay timer");
-    _delay_timer = *_vx;
+void Chip8::set_delay_timer(const Instruction &ins) {
+    _delay_timer = _v[ins.x];
 }
 
-void Chip8::set_sound_timer() {
-    SPDLOG_DEBUG("set sound timer");
-    _sound_timer = *_vx;
+void Chip8::set_sound_timer(const Instruction &ins) {
+    if ((_sound_timer > 0) != (_v[ins.x] > 0))
+        _event = StopReason::sound_timer;
+    _sound_timer = _v[ins.x];
 }
 
-void Chip8::add_to_i() {
-    SPDLOG_DEBUG("add to I");
-    _i += *_vx;
-    SPDLOG_DEBUG("I = 0x{:04X}", _i);
+void Chip8::add_to_i(const Instruction &ins) {
+    _i += _v[ins.x];
 }
 
-void Chip8::set_i_to_char() {
-    SPDLOG_DEBUG("set I to char");
-    _i = *_vx * 5;
+void Chip8::set_i_to_char(const Instruction &ins) {
+    _i = _v[ins.x] * 5;
 }
 
-void Chip8::store_decimal() {
-    SPDLOG_DEBUG("store_decimal");
-    _memory[_i] = *_vx / 100;
-    _memory[_i + 1] = (*_vx / 10) % 10;
-    _memory[_i + 2] = *_vx % 10;
+void Chip8::store_decimal(const Instruction &ins) {
+    write_memory(_i, _v[ins.x] / 100);
+    write_memory(_i + 1, (_v[ins.x] / 10) % 10);
+    write_memory(_i + 2, _v[ins.x] % 10);
 }
 
-void Chip8::dump_v() {
-    SPDLOG_DEBUG("dump V");
-    for (int i = 0 ; i <= _x ; ++i) {
-        _memory[_i++] = _v[i];
-        SPDLOG_DEBUG("v[{}] = {}", i, _v[i]);
+// Writes may invalidate the cached instruction, x is read before.
+template <bool IncrementI>
+void Chip8::dump_v(const Instruction &ins) {
+    uint8_t x = ins.x;
+    uint16_t addr = _i;
+    for (int i = 0 ; i <= x ; ++i) {
+        write_memory(addr++, _v[i]);
     }
+
+    if constexpr (IncrementI)
+        _i = addr;
 }
 
-void Chip8::load_v() {
-    SPDLOG_DEBUG("load V");
-    for (int i = 0 ; i <= _x ; ++i) {
-        SPDLOG_DEBUG("v[{}] = {}", i, _v[i]);
-        _v[i] = _memory[_i++];
+template <bool IncrementI>
+void Chip8::load_v(const Instruction &ins) {
+    uint16_t addr = _i;
+    for (int i = 0 ; i <= ins.x ; ++i) {
+        _v[i] = read_memory(addr++);
     }
 
-    #ifdef DEBUG
-    log_v();
-    #endif
+    if constexpr (IncrementI)
+        _i = addr;
 }
 
 } // namespace tools::chip8
\ No newline at end of file
@@ -1,16 +1,24 @@
 #ifndef CHIP8_HPP
 #define CHIP8_HPP
 
+#include <array>
+#include <bitset>
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
-#define MEMORY_SIZE 0xfff
+#include "Pages.hpp"
+#include "Quirks.hpp"
+
+#define MEMORY_SIZE 0x1000
 #define PROGRAM_START 0x200
-#define PROGRAM_SIZE MEMORY_SIZE-PROGRAM_START
+#define PROGRAM_SIZE (MEMORY_SIZE - PROGRAM_START)
 
 #define REGISTERS_SIZE 16
 #define KEYS 16
+#define STACK_SIZE 16
 
 // Graphics sizes
 #define WIDTH 64
@@ -19,37 +27,263 @@
 
 namespace tools::chip8 {
 
+class Explorer;
+class Jit;
+class Lockstep;
+class Trace;
+class VecEnv;
+
+namespace recompiler {
+class Runtime;
+}
+
 class Chip8 {
     public:
 
+    enum class Backend {
+        // Fetch and decode every instruction, see decode_execute().
+        interpreter,
+        // Decode each address once and dispatch from a table of handlers.
+        predecoded,
+        // Translate straight-line blocks to native code, see Jit.
+        // Other instructions, and all of them when the host is not x86-64, run predecoded.
+        jit
+    };
+
+    // Why run() returned.
+    enum class StopReason {
+        // The whole budget was executed.
+        budget,
+        // 00E0 or Dxyn updated the screen.
+        frame_drawn,
+        // Fx0A found no key pressed.
+        waiting_for_key,
+        // Fx18 started or stopped the sound.
+        sound_timer,
+        // 1nnn jumped to itself, nothing will happen until reset.
+        halt_loop,
+        // The program polls the delay timer in a Fx07 3x00 1nnn loop,
+        // nothing will happen until the timer runs out, see fast_forward_timers().
+        idle,
+        // pc reached a breakpoint, the instruction there is not executed yet.
+        breakpoint,
+        // 2nnn with a full stack or 00EE with an empty one, executed as a no-op.
+        stack_fault
+    };
+
+    struct RunResult {
+        uint32_t executed;
+        StopReason reason;
+    };
+
+    /**
+     * Whole machine state, see save_state().
+     * Serialized with a version and in little endian, see State.cpp.
+     */
+    struct State {
+        // Bumped on every change of the serialized layout, older versions still load.
+        static constexpr uint16_t VERSION = 2;
+        static const size_t SERIALIZED_SIZE;
+
+        /**
+         * @return Bytes of a serialized state of this version, 0 if it is not supported.
+         */
+        static size_t serialized_size(uint16_t version);
+
+        uint8_t memory[MEMORY_SIZE];
+        uint64_t screen[HEIGHT];
+        uint8_t v[REGISTERS_SIZE];
+        uint16_t pc;
+        uint16_t i;
+        uint16_t stack[STACK_SIZE];
+        uint8_t sp;
+        uint8_t delay_timer;
+        uint8_t sound_timer;
+        uint8_t keys[KEYS];
+        uint64_t rng;
+        // See get_instructions(), so that restoring a state also restores the clock of input logs.
+        uint64_t instructions;
+
+        /**
+         * @param out SERIALIZED_SIZE bytes.
+         */
+        void serialize(uint8_t *out) const;
+        std::vector<uint8_t> serialize() const;
+
+        /**
+         * Fields missing from older versions are set to 0.
+         * @return false if data is not a state of a supported version, the state is left as is.
+         */
+        bool deserialize(const uint8_t *data, size_t size);
+
+        bool save(const std::string &path) const;
+        bool load(const std::string &path);
+    };
+
     Chip8();
 
     ~Chip8();
 
     void reset();
+
+    /**
+     * @brief Seed the generator used by Cxnn.
+     * Two instances with the same seed, rom and inputs produce the same run.
+     * reset() keeps the generator state.
+     */
+    void seed(uint64_t seed);
+
     bool load_rom(const std::string &path);
+    bool load_rom(const std::vector<uint8_t> &rom);
+
+    /**
+     * @brief Map a rom image, shared with the other machines using it.
+     * Pages are copied from the arena when the program writes into them.
+     */
+    void load_rom(std::shared_ptr<const RomImage> image);
+
+    /**
+     * @brief Take the pages written by the program from this arena.
+     * Pages already copied stay in the previous one.
+     */
+    void set_page_arena(std::shared_ptr<PageArena> arena);
+
+    /**
+     * @brief Make this machine a copy of other: memory, screen, registers,
+     * stack, timers, keys and generator.
+     * Pages other shares with its rom image stay shared, written ones are copied.
+     * Backend, quirks, breakpoints and tracing are not copied.
+     */
+    void copy_state(const Chip8 &other);
+
+    /**
+     * @brief Copy the machine state, a few memcpy.
+     */
+    void save_state(State &state);
+
+    /**
+     * @brief Restore a state saved by save_state().
+     * Only pages that differ are copied, pages equal to the rom image are shared again.
+     */
+    void load_state(const State &state);
+
+    /**
+     * @return Number of pages this machine does not share with its rom image.
+     */
+    int get_owned_pages();
     void log_memory(uint16_t length = 0, uint16_t offset = 0);
     void dump_memory(const std::string &path);
 
     void log_v();
 
-    const bool *get_screen_buffer();
+    /**
+     * @brief Get the screen, one 64 bits word per row.
+     * The most significant bit of a row is its leftmost pixel.
+     * @return HEIGHT rows.
+     */
+    const uint64_t *get_screen_buffer();
+
+    /**
+     * @brief Convert a packed screen to one bool per pixel.
+     * @param rows HEIGHT rows as returned by get_screen_buffer().
+     * @param pixels SCREEN_SIZE pixels, row after row.
+     */
+    static void unpack_screen(const uint64_t *rows, bool *pixels);
+
+    /**
+     * @brief Hash of the screen content.
+     * Kept up to date by the instructions drawing, O(1).
+     */
+    uint64_t frame_hash();
+
+    /**
+     * @brief Hash of the whole machine: memory, screen, registers, stack,
+     * timers and generator. Keys are input, not state, and are left out.
+     * Screen and memory parts are kept up to date, registers are folded in here.
+     */
+    uint64_t state_hash();
+
+    /**
+     * @brief Term of the 8 bytes of memory from addr, a multiple of 8, in state_hash().
+     */
+    static uint64_t memory_term(uint16_t addr, uint64_t word);
+
     uint8_t get_sound_timer();
 
     void next_instruction();
+
+    /**
+     * @brief Execute up to budget instructions, stopping early on events.
+     * The event is reported after the instruction causing it, except for
+     * breakpoints. Resuming with run() executes the instruction at the breakpoint.
+     * @return Number of instructions executed and why execution stopped.
+     */
+    RunResult run(uint32_t budget);
+
+    /**
+     * @brief Record every executed instruction in a ring buffer.
+     * Blocks and fused sequences are executed one instruction at a time while tracing.
+     * @param capacity Number of instructions kept.
+     */
+    void enable_trace(size_t capacity = 1 << 16);
+    void disable_trace();
+    bool is_tracing();
+
+    /**
+     * @brief Write the traced instructions to a file, see chip8-trace to read it.
+     * @return true => ok ; false => error or not tracing.
+     */
+    bool dump_trace(const std::string &path);
+
+    void add_breakpoint(uint16_t addr);
+    void remove_breakpoint(uint16_t addr);
+    void clear_breakpoints();
     void decrease_timers();
 
+    /**
+     * @brief Run the timers out as if the delay timer had ticked down to 0.
+     * Meant for headless hosts after run() reported StopReason::idle.
+     * @param max_ticks Skip at most this many ticks, the delay timer keeps the rest.
+     * @return Number of timer ticks skipped.
+     */
+    uint8_t fast_forward_timers(uint8_t max_ticks = 0xff);
+
+    void set_backend(Backend backend);
+    Backend get_backend();
+
+    void set_quirks(const Quirks &quirks);
+    const Quirks &get_quirks();
+
+    /**
+     * @brief Use the quirks of a profile, see quirks_profiles().
+     * @return false if the profile is unknown.
+     */
+    bool set_quirks_profile(const std::string &name);
+
     void key_pressed(uint8_t key);
     void key_released(uint8_t key);
 
+    /**
+     * @brief Press the keys of a mask and release the others.
+     * @param keys Bit k is key k.
+     */
+    void set_keys(uint16_t keys);
+    uint16_t get_key_mask();
+
+    /**
+     * @return Instructions executed by run() since the last reset().
+     * Input logs use it as their clock, see InputLog.
+     */
+    uint64_t get_instructions();
+
 
     protected:
 
-    const uint8_t *get_memory();
+    uint8_t get_memory(uint16_t addr);
     const uint8_t *get_v();
     uint16_t get_pc();
     uint16_t get_i();
-    std::vector<uint16_t> get_stack();
+    std::span<const uint16_t> get_stack();
     uint8_t get_delay_timer();
     const uint8_t *get_keys();
 
@@ -61,72 +295,245 @@ class Chip8 {
 
     private:
 
+    // Recompiled roms work directly on the machine state.
+    friend class recompiler::Runtime;
+
+    // Moves registers in and out of its lanes.
+    friend class Lockstep;
+
+    // Read rewards and targets from memory.
+    friend class Explorer;
+    friend class VecEnv;
+
+    // Handlers of decoded instructions, see execute().
+    enum Op : uint8_t {
+        OP_UNDECODED = 0,
+        OP_NOP,
+        OP_CLS,
+        OP_RET,
+        OP_JUMP,
+        OP_CALL,
+        OP_SKIP_EQ,
+        OP_SKIP_NEQ,
+        OP_SKIP_EQ_X_Y,
+        OP_SET_VX,
+        OP_ADD_TO_VX,
+        OP_VX_TO_VY,
+        OP_VX_OR_VY,
+        OP_VX_AND_VY,
+        OP_VX_XOR_VY,
+        OP_VX_OR_VY_RESET_VF,
+        OP_VX_AND_VY_RESET_VF,
+        OP_VX_XOR_VY_RESET_VF,
+        OP_ADD_VY_TO_VX,
+        OP_SUB_VY_TO_VX,
+        OP_SHIFT_VX_RIGHT,
+        OP_VY_MINUS_VX,
+        OP_SHIFT_VX_LEFT,
+        OP_SHIFT_VY_RIGHT,
+        OP_SHIFT_VY_LEFT,
+        OP_SKIP_NEQ_X_Y,
+        OP_SET_I,
+        OP_JUMP_V0,
+        OP_JUMP_VX,
+        OP_RAND_AND,
+        OP_DRAW,
+        OP_DRAW_CLIP,
+        OP_SKIP_KEY_EQ,
+        OP_SKIP_KEY_NEQ,
+        OP_GET_DELAY,
+        OP_GET_KEY,
+        OP_SET_DELAY_TIMER,
+        OP_SET_SOUND_TIMER,
+        OP_ADD_TO_I,
+        OP_SET_I_TO_CHAR,
+        OP_STORE_DECIMAL,
+        OP_DUMP_V,
+        OP_LOAD_V,
+        OP_DUMP_V_KEEP_I,
+        OP_LOAD_V_KEEP_I,
+        OP_COUNT
+    };
+
+    // Handlers of common instruction sequences, indices into _fused_handlers.
+    enum Fused : uint8_t {
+        FUSED_NONE = 0,
+        FUSED_SET_VX_VY,    // 6xnn 6ynn
+        FUSED_SET_I_DRAW,   // Annn Dxyn
+        FUSED_WAIT_DELAY,   // Fx07 3x00 1nnn, nnn jumping back to Fx07
+        FUSED_COUNT
+    };
+
+    // Quirks as the template parameter of the interpreter, one bit per member of Quirks.
+    enum QuirkBits : uint8_t {
+        QUIRK_SHIFT_VY = 1,
+        QUIRK_INCREMENT_I = 2,
+        QUIRK_VF_RESET = 4,
+        QUIRK_CLIP = 8,
+        QUIRK_JUMP_VX = 16,
+        QUIRK_COMBINATIONS = 32
+    };
+
+    static uint8_t quirk_bits(const Quirks &quirks);
+
+    // Interpreter instantiated for one combination of QuirkBits,
+    // so that it does not test quirks, picked by set_quirks().
+    struct Interpreter {
+        RunResult (Chip8::*run)(uint32_t budget);
+        void (Chip8::*decode_execute)(uint16_t opcode);
+    };
+
+    template <uint8_t... Bits>
+    static constexpr std::array<Interpreter, sizeof...(Bits)> make_interpreters(std::integer_sequence<uint8_t, Bits...>);
+
+    static const std::array<Interpreter, QUIRK_COMBINATIONS> _interpreters;
+
+    // Longest sequence handled by a fused handler, in instructions.
+    static constexpr uint8_t FUSED_MAX_LENGTH = 3;
+
+    // An instruction decoded once and cached in _decoded.
+    struct Instruction {
+        uint8_t op; // OP_UNDECODED until the address is decoded.
+        uint8_t fused; // Sequence starting here, executed by run() only.
+        uint8_t x;
+        uint8_t y;
+        uint8_t const8;
+        uint8_t const4;
+        uint16_t addr;
+    };
+
+    // Fused handlers get the first instruction of the sequence,
+    // the following ones are at ins[2], ins[4]...
+    // They return the number of instructions executed.
+    using FusedHandler = uint8_t (Chip8::*)(const Instruction *ins);
+    static const FusedHandler _fused_handlers[FUSED_COUNT];
+
+    // Map an opcode to its handler, resolving the 0x0, 0x8, 0xe and 0xf sub-opcodes
+    // and picking the handler instantiated for the current quirks.
+    uint8_t decode(uint16_t opcode);
+
+    // Split an opcode into its operands, op is left OP_UNDECODED.
+    static Instruction decode_operands(uint16_t opcode);
+    uint16_t read_opcode(uint16_t addr);
+
+    uint8_t read_memory(uint16_t addr);
+
+    // Copy the page on first write, then drop what was decoded from addr.
+    void write_memory(uint16_t addr, uint8_t value);
+
+    // Give the copied pages back to the arena.
+    void release_pages();
+    void predecode(uint16_t addr);
+    void predecode_operands(uint16_t addr);
+    uint8_t predecode_fused(uint16_t addr);
+    Instruction &predecoded(uint16_t addr);
+    void execute_predecoded();
+
+    // Run the handler of a decoded instruction, pc already points past it.
+    void execute(const Instruction &ins);
+
+    // run() for the predecoded backend without breakpoints nor tracing.
+    RunResult run_predecoded(uint32_t budget);
+
+    // run() and decode_execute() for the interpreter backend, see Interpreter.
+    template <uint8_t Bits> RunResult run_interpreter(uint32_t budget);
+    template <uint8_t Bits> void decode_execute_quirks(uint16_t opcode);
+    void execute_traced();
+
+    // Whether addr starts a Fx07 3x00 1nnn loop polling the delay timer.
+    bool is_delay_wait_loop(uint16_t addr);
+
+    // Whether run() must go one instruction at a time.
+    void update_single_step();
+
+    // Fused handlers.
+    uint8_t fused_set_vx_vy(const Instruction *ins);
+    uint8_t fused_set_i_draw(const Instruction *ins);
+    uint8_t fused_wait_delay(const Instruction *ins);
+
+    // Drop cached instructions overlapping a written address.
+    void invalidate(uint16_t addr);
+    void invalidate_all();
+
     // Opcodes implementations.
 
+    // Unknown opcodes.
+    void nop(const Instruction &ins);
+
     // opcode 0x0xxx
-    void decode_op_0();
-    void cls();
-    void ret();
+    void decode_op_0(const Instruction &ins);
+    void cls(const Instruction &ins);
+    void ret(const Instruction &ins);
     ////////////////
 
-    void jump();
-    void call();
+    void jump(const Instruction &ins);
+    void call(const Instruction &ins);
 
     // Skip next instruction if V[x] == value.
-    void skip_eq();
+    void skip_eq(const Instruction &ins);
 
     // Skip next instruction if V[x] != value.
-    void skip_neq();
+    void skip_neq(const Instruction &ins);
 
     // Skip next instruction if V[x] == V[y].
-    void skip_eq_x_y();
+    void skip_eq_x_y(const Instruction &ins);
 
-    void set_vx();
-    void add_to_vx();
+    void set_vx(const Instruction &ins);
+    void add_to_vx(const Instruction &ins);
 
     // opcodes 0x8xxx
-    void decode_op_8();
-    void vx_to_vy();
-    void vx_or_vy();
-    void vx_and_vy();
-    void vx_xor_vy();
-    void add_vy_to_vx();
-    void sub_vy_to_vx();
-    void shift_vx_right();
-    void vy_minus_vx();
-    void shift_vx_left();
+    // Quirk dependent handlers are instantiated once per behaviour,
+    // see Quirks for the template parameters.
+    template <uint8_t Bits> void decode_op_8(const Instruction &ins);
+    void vx_to_vy(const Instruction &ins);
+    template <bool ResetVf> void vx_or_vy(const Instruction &ins);
+    template <bool ResetVf> void vx_and_vy(const Instruction &ins);
+    template <bool ResetVf> void vx_xor_vy(const Instruction &ins);
+    void add_vy_to_vx(const Instruction &ins);
+    void sub_vy_to_vx(const Instruction &ins);
+    template <bool ShiftVy> void shift_vx_right(const Instruction &ins);
+    void vy_minus_vx(const Instruction &ins);
+    template <bool ShiftVy> void shift_vx_left(const Instruction &ins);
     /////////////////
 
-    void skip_neq_x_y();
-    void set_i();
-    void jump_v0();
-    void rand_and();
-    void draw();
+    void skip_neq_x_y(const Instruction &ins);
+    void set_i(const Instruction &ins);
+    template <bool JumpVx> void jump_v0(const Instruction &ins);
+    void rand_and(const Instruction &ins);
+    uint8_t next_random();
+    template <bool Clip> void draw(const Instruction &ins);
 
     // opcodes 0xexxx
-    void decode_op_e();
-    void skip_key_eq();
-    void skip_key_neq();
+    void decode_op_e(const Instruction &ins);
+    void skip_key_eq(const Instruction &ins);
+    void skip_key_neq(const Instruction &ins);
     /////////////////
 
     // opcodes 0xfxxx
-    void decode_op_f();
-    void get_delay();
-    void get_key();
-    void set_delay_timer();
-    void set_sound_timer();
-    void add_to_i();
-    void set_i_to_char();
-    void store_decimal();
-    void dump_v();
-    void load_v();
+    template <uint8_t Bits> void decode_op_f(const Instruction &ins);
+    void get_delay(const Instruction &ins);
+    void get_key(const Instruction &ins);
+    void set_delay_timer(const Instruction &ins);
+    void set_sound_timer(const Instruction &ins);
+    void add_to_i(const Instruction &ins);
+    void set_i_to_char(const Instruction &ins);
+    void store_decimal(const Instruction &ins);
+    template <bool IncrementI> void dump_v(const Instruction &ins);
+    template <bool IncrementI> void load_v(const Instruction &ins);
     /////////////////
 
-    // 0xfff (4095) bytes of RAM.
-    uint8_t _memory[MEMORY_SIZE];
+    // 4 KiB of RAM, one pointer per page of MEMORY_PAGE_SIZE bytes.
+    // Pages point into _image until written, see write_memory().
+    const uint8_t *_pages[MEMORY_PAGES];
+
+    // Pages copied from _image into _arena, one bit per page.
+    uint16_t _owned_pages = 0;
+
+    std::shared_ptr<const RomImage> _image;
+    std::shared_ptr<PageArena> _arena;
 
-    // Buffer holding screen data.
-    bool _screen[SCREEN_SIZE];
+    // Buffer holding screen data, one bit per pixel, see get_screen_buffer().
+    uint64_t _screen[HEIGHT];
 
     // CPU registers, named V0 to VF.
     // VF is used in some operations as a carry flag for example.
@@ -138,8 +545,9 @@ class Chip8 {
     // Used by several opcodes doing memory operations.
     uint16_t _i;
 
-    // For subroutines returns.
-    std::vector<uint16_t> _stack;
+    // For subroutines returns, _sp is the number of entries.
+    uint16_t _stack[STACK_SIZE];
+    uint8_t _sp;
 
     // Delay timer.
     uint8_t _delay_timer;
@@ -151,19 +559,44 @@ class Chip8 {
     // Used for random number generation.
     uint8_t _random;
 
+    // xorshift64* state, per instance so that runs are reproducible, see seed().
+    uint64_t _rng;
+
+    // Sum of the instructions executed by run().
+    uint64_t _instructions = 0;
+
+    // Terms of the screen rows and of the memory words in state_hash(),
+    // replaced as they are written.
+    uint64_t _frame_hash;
+    uint64_t _memory_hash;
+
     // Used as a buffer in some operations.
     uint16_t _tmp;
 
+    Backend _backend = Backend::interpreter;
+
+    Quirks _quirks;
+
+    // Entry of _interpreters for _quirks.
+    const Interpreter *_interpreter;
+
+    // Set by handlers to make run() return.
+    StopReason _event = StopReason::budget;
+
+    // Only allocated while there are breakpoints.
+    std::unique_ptr<std::bitset<MEMORY_SIZE>> _breakpoints;
+
+    // Only allocated while tracing.
+    std::unique_ptr<Trace> _trace;
+
+    // Set while breakpoints or tracing need every instruction to go through next_instruction().
+    bool _single_step = false;
+
+    // One entry per memory address, only allocated for the predecoded and jit backends.
+    std::unique_ptr<Instruction[]> _decoded;
 
-    // opcode details
-    uint8_t _msb; // most significant 4 bits of the opcode.
-    uint16_t _addr; // 12 less significant bits of the opcode ; used for addresses.
-    uint8_t _const8; // 8 less significant bits of the opcode
-    uint8_t _const4; // 4 less significant bits of the opcode
-    uint8_t _x;
-    uint8_t _y;
-    uint8_t *_vx; // v register pointed by the 0x0f00 bits of the opcode
-    uint8_t *_vy; // v register pointed by the 0x00f0 bits of the opcode
+    // Only allocated for the jit backend.
+    std::unique_ptr<Jit> _jit;
 };
 
 } // namespace tools::chip8
@@ -0,0 +1,63 @@
+#include "ConcurrentHashSet.hpp"
+
+#include <bit>
+
+namespace tools::utils {
+
+ConcurrentHashSet::ConcurrentHashSet(size_t capacity) {
+    capacity = std::bit_ceil(capacity < 2 ? 2 : capacity);
+    _mask = capacity - 1;
+    _buckets = std::make_unique<std::atomic<uint64_t>[]>(capacity);
+    for (size_t i = 0 ; i < capacity ; ++i)
+        _buckets[i].store(0, std::memory_order_relaxed);
+}
+
+ConcurrentHashSet::~ConcurrentHashSet() {}
+
+ConcurrentHashSet::Insert ConcurrentHashSet::insert(uint64_t hash) {
+    if (hash == 0)
+        hash = ZERO;
+
+    size_t index = hash & _mask;
+    for (size_t probe = 0 ; probe <= _mask ; ++probe) {
+        std::atomic<uint64_t> &bucket = _buckets[(index + probe) & _mask];
+        uint64_t current = bucket.load(std::memory_order_relaxed);
+
+        if (current == 0) {
+            // Another thread may take the bucket first, with this very hash or not.
+            if (bucket.compare_exchange_strong(current, hash, std::memory_order_relaxed)) {
+                _size.fetch_add(1, std::memory_order_relaxed);
+                return Insert::added;
+            }
+        }
+
+        if (current == hash)
+            return Insert::present;
+    }
+    return Insert::full;
+}
+
+bool ConcurrentHashSet::contains(uint64_t hash) {
+    if (hash == 0)
+        hash = ZERO;
+
+    size_t index = hash & _mask;
+    for (size_t probe = 0 ; probe <= _mask ; ++probe) {
+        uint64_t current = _buckets[(index + probe) & _mask].load(std::memory_order_relaxed);
+        if (current == hash)
+            return true;
+        if (current == 0)
+            return false;
+    }
+    return false;
+}
+
+size_t ConcurrentHashSet::size() {
+    return _size.load(std::memory_order_relaxed);
+}
+
+size_t ConcurrentHashSet::capacity() {
+    return _mask + 1;
+}
+
+} // namespace tools::utils
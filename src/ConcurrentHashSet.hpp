@@ -0,0 +1,50 @@
+#ifndef CONCURRENTHASHSET_HPP
+#define CONCURRENTHASHSET_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace tools::utils {
+
+/**
+ * @brief Fixed capacity set of 64 bits hashes, lock free.
+ * Open addressing with linear probing, hashes are expected to be well mixed.
+ */
+class ConcurrentHashSet {
+    public:
+
+    enum class Insert {
+        added,
+        // The hash was already in the set.
+        present,
+        // No room left, the hash was not added.
+        full
+    };
+
+    /**
+     * @param capacity Rounded up to a power of two.
+     * Probing gets slow past 3/4 of it.
+     */
+    ConcurrentHashSet(size_t capacity);
+    ~ConcurrentHashSet();
+
+    Insert insert(uint64_t hash);
+    bool contains(uint64_t hash);
+
+    size_t size();
+    size_t capacity();
+
+    private:
+
+    // 0 marks empty buckets, hashes equal to 0 are stored as this.
+    static constexpr uint64_t ZERO = 0x8000000000000000ull;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> _buckets;
+    size_t _mask;
+    std::atomic<size_t> _size = 0;
+};
+
+} // namespace tools::utils
+
+#endif // CONCURRENTHASHSET_HPP
@@ -0,0 +1,69 @@
+#include "Disassembler.hpp"
+
+#include "spdlog/fmt/fmt.h"
+
+namespace tools::chip8 {
+
+std::string disassemble(uint16_t opcode) {
+    uint8_t x = (opcode >> 8) & 0x000f;
+    uint8_t y = (opcode >> 4) & 0x000f;
+    uint8_t const8 = opcode & 0x00ff;
+    uint8_t const4 = opcode & 0x000f;
+    uint16_t addr = opcode & 0x0fff;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00e0) return "CLS";
+            if (opcode == 0x00ee) return "RET";
+            break;
+        case 0x1: return fmt::format("JP 0x{:03X}", addr);
+        case 0x2: return fmt::format("CALL 0x{:03X}", addr);
+        case 0x3: return fmt::format("SE V{:X}, 0x{:02X}", x, const8);
+        case 0x4: return fmt::format("SNE V{:X}, 0x{:02X}", x, const8);
+        case 0x5: return fmt::format("SE V{:X}, V{:X}", x, y);
+        case 0x6: return fmt::format("LD V{:X}, 0x{:02X}", x, const8);
+        case 0x7: return fmt::format("ADD V{:X}, 0x{:02X}", x, const8);
+        case 0x8:
+            switch (const4) {
+                case 0x0: return fmt::format("LD V{:X}, V{:X}", x, y);
+                case 0x1: return fmt::format("OR V{:X}, V{:X}", x, y);
+                case 0x2: return fmt::format("AND V{:X}, V{:X}", x, y);
+                case 0x3: return fmt::format("XOR V{:X}, V{:X}", x, y);
+                case 0x4: return fmt::format("ADD V{:X}, V{:X}", x, y);
+                case 0x5: return fmt::format("SUB V{:X}, V{:X}", x, y);
+                case 0x6: return fmt::format("SHR V{:X}", x);
+                case 0x7: return fmt::format("SUBN V{:X}, V{:X}", x, y);
+                case 0xe: return fmt::format("SHL V{:X}", x);
+                default: break;
+            }
+            break;
+        case 0x9: return fmt::format("SNE V{:X}, V{:X}", x, y);
+        case 0xa: return fmt::format("LD I, 0x{:03X}", addr);
+        case 0xb: return fmt::format("JP V0, 0x{:03X}", addr);
+        case 0xc: return fmt::format("RND V{:X}, 0x{:02X}", x, const8);
+        case 0xd: return fmt::format("DRW V{:X}, V{:X}, {}", x, y, const4);
+        case 0xe:
+            if (const8 == 0x9e) return fmt::format("SKP V{:X}", x);
+            if (const8 == 0xa1) return fmt::format("SKNP V{:X}", x);
+            break;
+        case 0xf:
+            switch (const8) {
+                case 0x07: return fmt::format("LD V{:X}, DT", x);
+                case 0x0a: return fmt::format("LD V{:X}, K", x);
+                case 0x15: return fmt::format("LD DT, V{:X}", x);
+                case 0x18: return fmt::format("LD ST, V{:X}", x);
+                case 0x1e: return fmt::format("ADD I, V{:X}", x);
+                case 0x29: return fmt::format("LD F, V{:X}", x);
+                case 0x33: return fmt::format("LD B, V{:X}", x);
+                case 0x55: return fmt::format("LD [I], V{:X}", x);
+                case 0x65: return fmt::format("LD V{:X}, [I]", x);
+                default: break;
+            }
+            break;
+        default: break;
+    }
+
+    return fmt::format("DATA 0x{:04X}", opcode);
+}
+
+} // namespace tools::chip8
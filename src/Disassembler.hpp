@@ -0,0 +1,18 @@
+#ifndef DISASSEMBLER_HPP
+#define DISASSEMBLER_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace tools::chip8 {
+
+/**
+ * @brief Get the assembly mnemonic of an opcode, e.g. "LD V1, 0x2A".
+ * @param opcode Opcode to disassemble.
+ * @return Mnemonic, or "DATA 0xNNNN" for unknown opcodes.
+ */
+std::string disassemble(uint16_t opcode);
+
+} // namespace tools::chip8
+
+#endif // DISASSEMBLER_HPP
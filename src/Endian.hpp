@@ -0,0 +1,34 @@
+#ifndef ENDIAN_HPP
+#define ENDIAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tools::utils {
+
+/**
+ * @brief Write an integer in little endian, whatever the host.
+ * @return Past the written bytes.
+ */
+template <typename T>
+uint8_t *put_le(uint8_t *out, T value) {
+    for (size_t byte = 0 ; byte < sizeof(T) ; ++byte)
+        *out++ = (value >> (byte * 8)) & 0xff;
+    return out;
+}
+
+/**
+ * @brief Read an integer written by put_le().
+ * @return Past the read bytes.
+ */
+template <typename T>
+const uint8_t *get_le(const uint8_t *in, T &value) {
+    value = 0;
+    for (size_t byte = 0 ; byte < sizeof(T) ; ++byte)
+        value |= (T)in[byte] << (byte * 8);
+    return in + sizeof(T);
+}
+
+} // namespace tools::utils
+
+#endif // ENDIAN_HPP
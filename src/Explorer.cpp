@@ -0,0 +1,286 @@
+#include "Explorer.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include "ConcurrentHashSet.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+// Nodes expanded per batch and per thread.
+#define BATCH_PER_THREAD 64
+// Children run per work item.
+#define CHILD_GRAIN 4
+// Page arenas per thread, work items spread over them.
+#define ARENAS_PER_THREAD 4
+
+namespace tools::chip8 {
+
+Explorer::Explorer(unsigned threads) : _pool(threads) {
+    for (unsigned i = 0 ; i < _pool.size() * ARENAS_PER_THREAD ; ++i)
+        _arenas.push_back(std::make_shared<PageArena>());
+    _start = make_machine();
+
+    _inputs.push_back(0);
+    for (int key = 0 ; key < KEYS ; ++key)
+        _inputs.push_back(1 << key);
+}
+
+Explorer::~Explorer() {}
+
+unsigned Explorer::threads() {
+    return _pool.size();
+}
+
+bool Explorer::load_rom(const std::vector<uint8_t> &rom) {
+    _start->reset();
+    return _start->load_rom(rom);
+}
+
+bool Explorer::set_quirks_profile(const std::string &name) {
+    if (!_start->set_quirks_profile(name))
+        return false;
+    _quirks = _start->get_quirks();
+    return true;
+}
+
+void Explorer::seed(uint64_t seed) {
+    _start->seed(seed);
+}
+
+void Explorer::set_cpu_freq(uint32_t cpu_freq) {
+    if (cpu_freq < 60) {
+        SPDLOG_ERROR("CPU frequency must be at least 60 Hz.");
+        return;
+    }
+    _frame_budget = cpu_freq / 60;
+}
+
+void Explorer::set_frames_per_input(uint32_t frames) {
+    if (frames == 0) {
+        SPDLOG_ERROR("Inputs must be held for at least 1 frame.");
+        return;
+    }
+    _frames_per_input = frames;
+}
+
+void Explorer::set_inputs(const std::vector<uint16_t> &inputs) {
+    if (inputs.empty()) {
+        SPDLOG_ERROR("At least one input is needed.");
+        return;
+    }
+    _inputs = inputs;
+}
+
+void Explorer::set_search(Search search) {
+    _search = search;
+}
+
+void Explorer::set_score(uint16_t addr) {
+    _score_addr = addr;
+}
+
+Explorer::Result Explorer::explore(const Target &target, uint64_t max_states, uint32_t max_depth) {
+    Result result;
+
+    size_t inputs = _inputs.size();
+    size_t batch_size = (size_t)BATCH_PER_THREAD * _pool.size();
+
+    // A batch may add all of its children after the limit is reached.
+    // The set stays under half full.
+    tools::utils::ConcurrentHashSet seen(2 * (max_states + batch_size * inputs));
+    std::vector<Record> records;
+
+    Node root;
+    root.cpu = make_machine();
+    root.cpu->copy_state(*_start);
+    root.hash = root.cpu->state_hash();
+    root.record = 0;
+    root.depth = 0;
+    root.score = root.cpu->get_memory(_score_addr);
+
+    seen.insert(root.hash);
+    records.push_back({ UINT32_MAX, 0 });
+
+    if (is_met(*root.cpu, target)) {
+        result.found = true;
+        result.states = 1;
+        return result;
+    }
+
+    // Best first keeps a heap of the highest scores, shallowest first on ties.
+    auto lower_priority = [](const Node &a, const Node &b) {
+        return a.score < b.score || (a.score == b.score && a.depth > b.depth);
+    };
+
+    std::deque<Node> queue;
+    std::vector<Node> heap;
+    if (_search == Search::breadth_first)
+        queue.push_back(std::move(root));
+    else
+        heap.push_back(std::move(root));
+
+    std::vector<Node> batch;
+    std::vector<Child> children;
+    std::atomic<uint64_t> duplicates = 0;
+
+    while (seen.size() < max_states && !(queue.empty() && heap.empty())) {
+        batch.clear();
+        while (batch.size() < batch_size && !(queue.empty() && heap.empty())) {
+            if (_search == Search::breadth_first) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            else {
+                std::pop_heap(heap.begin(), heap.end(), lower_priority);
+                batch.push_back(std::move(heap.back()));
+                heap.pop_back();
+            }
+        }
+
+        children.clear();
+        children.resize(batch.size() * inputs);
+
+        // Threads only step and hash the children, at fixed indices.
+        // The set is read only meanwhile, new states are added by the merge
+        // below in child order, so the same child wins whatever thread ran it.
+        _pool.parallel_for(children.size(), CHILD_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t c = begin ; c < end ; ++c) {
+                const Node &node = batch[c / inputs];
+                if (node.depth >= max_depth)
+                    continue;
+
+                std::unique_ptr<Chip8> cpu = make_machine(begin / CHILD_GRAIN);
+                cpu->copy_state(*node.cpu);
+                cpu->set_keys(_inputs[c % inputs]);
+
+                Child &child = children[c];
+                child.halted = !run_step(*cpu);
+                child.hash = cpu->state_hash();
+
+                // States found by earlier batches.
+                if (seen.contains(child.hash))
+                    duplicates.fetch_add(1, std::memory_order_relaxed);
+                else
+                    child.cpu = std::move(cpu);
+            }
+        });
+
+        for (size_t b = 0 ; b < batch.size() ; ++b) {
+            Node &node = batch[b];
+            if (node.depth >= max_depth)
+                continue;
+            result.depth = std::max(result.depth, node.depth);
+
+            // Every input leads back to the same state.
+            bool stuck = true;
+
+            for (size_t k = 0 ; k < inputs ; ++k) {
+                Child &child = children[b * inputs + k];
+                if (child.hash != node.hash)
+                    stuck = false;
+                if (!child.cpu)
+                    continue;
+
+                // Another child of this batch reached the same state first.
+                if (seen.insert(child.hash) != tools::utils::ConcurrentHashSet::Insert::added) {
+                    child.cpu.reset();
+                    ++duplicates;
+                    continue;
+                }
+
+                uint32_t record = records.size();
+                records.push_back({ node.record, _inputs[k] });
+
+                if (is_met(*child.cpu, target)) {
+                    result.found = true;
+                    result.inputs = path(records, record);
+                    result.states = seen.size();
+                    result.duplicates = duplicates;
+                    return result;
+                }
+
+                if (child.halted) {
+                    if (result.soft_locks++ == 0)
+                        result.soft_lock_inputs = path(records, record);
+                    continue;
+                }
+
+                Node next;
+                next.hash = child.hash;
+                next.record = record;
+                next.depth = node.depth + 1;
+                next.score = child.cpu->get_memory(_score_addr);
+                next.cpu = std::move(child.cpu);
+
+                if (_search == Search::breadth_first) {
+                    queue.push_back(std::move(next));
+                }
+                else {
+                    heap.push_back(std::move(next));
+                    std::push_heap(heap.begin(), heap.end(), lower_priority);
+                }
+            }
+
+            if (stuck && result.soft_locks++ == 0)
+                result.soft_lock_inputs = path(records, node.record);
+        }
+    }
+
+    result.states = seen.size();
+    result.duplicates = duplicates;
+    return result;
+}
+
+std::unique_ptr<Chip8> Explorer::make_machine(size_t stripe) {
+    auto cpu = std::make_unique<Chip8>();
+    cpu->set_quirks(_quirks);
+    cpu->set_page_arena(_arenas[stripe % _arenas.size()]);
+    return cpu;
+}
+
+bool Explorer::run_step(Chip8 &cpu) {
+    using StopReason = Chip8::StopReason;
+
+    for (uint32_t frame = 0 ; frame < _frames_per_input ; ++frame) {
+        uint32_t budget = _frame_budget;
+        while (budget > 0) {
+            Chip8::RunResult result = cpu.run(budget);
+            budget -= result.executed;
+
+            if (result.reason == StopReason::halt_loop)
+                return false;
+
+            // Nothing happens until the next frame.
+            if (result.reason == StopReason::idle
+                || result.reason == StopReason::waiting_for_key)
+                break;
+        }
+        cpu.decrease_timers();
+    }
+    return true;
+}
+
+bool Explorer::is_met(Chip8 &cpu, const Target &target) {
+    uint8_t value = cpu.get_memory(target.addr);
+    switch (target.compare) {
+        case Compare::equal:            return value == target.value;
+        case Compare::not_equal:        return value != target.value;
+        case Compare::less:             return value < target.value;
+        case Compare::less_equal:       return value <= target.value;
+        case Compare::greater:          return value > target.value;
+        case Compare::greater_equal:    return value >= target.value;
+    }
+    return false;
+}
+
+std::vector<uint16_t> Explorer::path(const std::vector<Record> &records, uint32_t record) {
+    std::vector<uint16_t> inputs;
+    for ( ; records[record].parent != UINT32_MAX ; record = records[record].parent)
+        inputs.push_back(records[record].input);
+    std::reverse(inputs.begin(), inputs.end());
+    return inputs;
+}
+
+} // namespace tools::chip8
@@ -0,0 +1,159 @@
+#ifndef EXPLORER_HPP
+#define EXPLORER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Chip8.hpp"
+#include "ThreadPool.hpp"
+
+namespace tools::chip8 {
+
+/**
+ * @brief Search the states a rom can reach by pressing keys at frame boundaries.
+ * Every state is expanded once per input, and states already seen are dropped
+ * by their Chip8::state_hash(). Nodes are expanded by batches on a thread pool.
+ */
+class Explorer {
+    public:
+
+    enum class Search {
+        // Shortest input sequences first.
+        breadth_first,
+        // Highest score first, see set_score().
+        best_first
+    };
+
+    enum class Compare {
+        equal,
+        not_equal,
+        less,
+        less_equal,
+        greater,
+        greater_equal
+    };
+
+    // Met when the byte at addr compares to value.
+    struct Target {
+        uint16_t addr;
+        Compare compare;
+        uint8_t value;
+    };
+
+    struct Result {
+        bool found = false;
+        // Key masks held for each step, from reset to the target.
+        std::vector<uint16_t> inputs;
+
+        // Distinct states reached.
+        uint64_t states = 0;
+        // Expansions leading to a state already seen.
+        uint64_t duplicates = 0;
+        // Deepest expanded state, in steps.
+        uint32_t depth = 0;
+
+        // States where the rom halted or that no input changes.
+        uint64_t soft_locks = 0;
+        // Key masks leading to the first soft lock found.
+        std::vector<uint16_t> soft_lock_inputs;
+    };
+
+    /**
+     * @param threads See ThreadPool.
+     */
+    Explorer(unsigned threads = 0);
+    ~Explorer();
+
+    unsigned threads();
+
+    bool load_rom(const std::vector<uint8_t> &rom);
+    bool set_quirks_profile(const std::string &name);
+
+    /**
+     * @brief Seed of the generator of the initial state, see Chip8::seed().
+     */
+    void seed(uint64_t seed);
+
+    /**
+     * @param cpu_freq Instructions per second of emulated time, at least 60.
+     * Every frame runs cpu_freq / 60 instructions.
+     */
+    void set_cpu_freq(uint32_t cpu_freq);
+
+    /**
+     * @brief Number of frames each input is held for, one step of the search.
+     */
+    void set_frames_per_input(uint32_t frames);
+
+    /**
+     * @brief Key masks tried from every state, bit k being key k.
+     * Defaults to no key then each of the 16 keys alone.
+     */
+    void set_inputs(const std::vector<uint16_t> &inputs);
+
+    void set_search(Search search);
+
+    /**
+     * @brief Best first search expands states with the highest byte at addr first.
+     */
+    void set_score(uint16_t addr);
+
+    /**
+     * @brief Search from the state after load_rom() until a state meets target.
+     * @param max_states Stop after reaching this many distinct states.
+     * @param max_depth States this many steps away from the start are not expanded.
+     */
+    Result explore(const Target &target, uint64_t max_states, uint32_t max_depth = UINT32_MAX);
+
+    private:
+
+    // A state waiting to be expanded.
+    struct Node {
+        std::unique_ptr<Chip8> cpu;
+        uint64_t hash;
+        uint32_t record;
+        uint32_t depth;
+        uint8_t score;
+    };
+
+    // How a state was reached, for every state reached.
+    struct Record {
+        uint32_t parent;
+        uint16_t input;
+    };
+
+    // Result of one input applied to a node of a batch.
+    struct Child {
+        std::unique_ptr<Chip8> cpu;
+        uint64_t hash;
+        bool halted;
+    };
+
+    // Machines of different stripes take their pages from different arenas,
+    // so that threads expanding different work items rarely wait on the same lock.
+    std::unique_ptr<Chip8> make_machine(size_t stripe = 0);
+
+    // Run the frames of one step.
+    // @return false if the rom halted.
+    bool run_step(Chip8 &cpu);
+
+    bool is_met(Chip8 &cpu, const Target &target);
+    std::vector<uint16_t> path(const std::vector<Record> &records, uint32_t record);
+
+    tools::utils::ThreadPool _pool;
+    std::vector<std::shared_ptr<PageArena>> _arenas;
+
+    std::unique_ptr<Chip8> _start;
+    Quirks _quirks;
+    uint32_t _frame_budget = 1000 / 60;
+    uint32_t _frames_per_input = 1;
+    std::vector<uint16_t> _inputs;
+    Search _search = Search::breadth_first;
+    uint16_t _score_addr = 0;
+};
+
+} // namespace tools::chip8
+
+#endif // EXPLORER_HPP
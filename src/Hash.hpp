@@ -0,0 +1,29 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstdint>
+
+namespace tools::chip8 {
+
+/**
+ * @brief Mix the bits of a 64 bits value (splitmix64 finalizer).
+ * Used to build hashes as XORs of independent terms,
+ * so that a term can be replaced without rehashing the others.
+ */
+constexpr uint64_t mix64(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief Hash term of a value found at a position.
+ */
+constexpr uint64_t hash_term(uint64_t position, uint64_t value) {
+    return mix64(mix64(position) ^ value);
+}
+
+} // namespace tools::chip8
+
+#endif // HASH_HPP
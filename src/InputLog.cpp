@@ -0,0 +1,175 @@
+#include "InputLog.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include "Endian.hpp"
+#include "files.hpp"
+
+#include <cstring>
+
+// Layout, every integer in little endian :
+//   "C8IN", u16 version, u16 reserved, serialized starting state,
+//   u64 end instruction, u64 end state hash, u32 event count,
+//   then per event u64 instruction, u8 type, u16 keys.
+#define INPUT_LOG_MAGIC "C8IN"
+#define INPUT_LOG_VERSION 1
+#define INPUT_LOG_HEADER_SIZE 8
+#define INPUT_LOG_EVENT_SIZE 11
+
+namespace tools::chip8 {
+
+using utils::get_le;
+using utils::put_le;
+
+InputLog::InputLog() :
+    _start(std::make_unique<Chip8::State>())
+{}
+
+InputLog::~InputLog() {}
+
+void InputLog::start(Chip8 &cpu) {
+    cpu.save_state(*_start);
+    _events.clear();
+    _base = cpu.get_instructions();
+    _recording = true;
+}
+
+void InputLog::record_keys(Chip8 &cpu) {
+    if (_recording)
+        _events.push_back({ cpu.get_instructions() - _base, Type::keys, cpu.get_key_mask() });
+}
+
+void InputLog::record_timers(Chip8 &cpu) {
+    if (_recording)
+        _events.push_back({ cpu.get_instructions() - _base, Type::timers, 0 });
+}
+
+void InputLog::stop(Chip8 &cpu) {
+    if (!_recording)
+        return;
+    _end_instruction = cpu.get_instructions() - _base;
+    _end_hash = cpu.state_hash();
+    _recording = false;
+}
+
+bool InputLog::is_recording() {
+    return _recording;
+}
+
+bool InputLog::replay(Chip8 &cpu) {
+    cpu.load_state(*_start);
+    uint64_t base = cpu.get_instructions();
+
+    for (const Event &event : _events) {
+        if (!run_to(cpu, base, event.instruction))
+            return false;
+
+        if (event.type == Type::keys)
+            cpu.set_keys(event.keys);
+        else
+            cpu.decrease_timers();
+    }
+
+    if (!run_to(cpu, base, _end_instruction))
+        return false;
+
+    if (cpu.state_hash() != _end_hash) {
+        SPDLOG_ERROR("Replay diverged, state hash is {:016x}, expected {:016x}.", cpu.state_hash(), _end_hash);
+        return false;
+    }
+    return true;
+}
+
+const std::vector<InputLog::Event> &InputLog::get_events() {
+    return _events;
+}
+
+bool InputLog::run_to(Chip8 &cpu, uint64_t base, uint64_t instruction) {
+    while (cpu.get_instructions() - base < instruction) {
+        uint64_t remaining = instruction - (cpu.get_instructions() - base);
+        Chip8::RunResult result = cpu.run(remaining > UINT32_MAX ? UINT32_MAX : remaining);
+
+        // run() executes at least one instruction, do not spin on a broken machine anyway.
+        if (result.executed == 0) {
+            SPDLOG_ERROR("Replay stuck at instruction {}.", cpu.get_instructions() - base);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InputLog::save(const std::string &path) {
+    size_t header = INPUT_LOG_HEADER_SIZE + Chip8::State::SERIALIZED_SIZE;
+    std::vector<uint8_t> data(header + 20 + _events.size() * INPUT_LOG_EVENT_SIZE);
+
+    uint8_t *out = data.data();
+    memcpy(out, INPUT_LOG_MAGIC, 4);
+    out = put_le<uint16_t>(out + 4, INPUT_LOG_VERSION);
+    out = put_le<uint16_t>(out, 0);
+    _start->serialize(out);
+    out += Chip8::State::SERIALIZED_SIZE;
+
+    out = put_le(out, _end_instruction);
+    out = put_le(out, _end_hash);
+    out = put_le<uint32_t>(out, _events.size());
+    for (const Event &event : _events) {
+        out = put_le(out, event.instruction);
+        *out++ = (uint8_t)event.type;
+        out = put_le(out, event.keys);
+    }
+
+    if (!utils::files::write_binary_file(data, path)) {
+        SPDLOG_ERROR("Failed to write input log '{}'.", path);
+        return false;
+    }
+    return true;
+}
+
+bool InputLog::load(const std::string &path) {
+    std::vector<uint8_t> data = utils::files::read_binary_file(path);
+
+    // Logs keep the starting state in the version it was saved with.
+    uint16_t state_version = 0;
+    if (data.size() >= INPUT_LOG_HEADER_SIZE + 6)
+        get_le(data.data() + INPUT_LOG_HEADER_SIZE + 4, state_version);
+    size_t state_size = Chip8::State::serialized_size(state_version);
+    size_t header = INPUT_LOG_HEADER_SIZE + state_size;
+
+    if (state_size == 0 || data.size() < header + 20 || memcmp(data.data(), INPUT_LOG_MAGIC, 4) != 0) {
+        SPDLOG_ERROR("'{}' is not an input log.", path);
+        return false;
+    }
+
+    uint16_t version;
+    get_le(data.data() + 4, version);
+    if (version != INPUT_LOG_VERSION) {
+        SPDLOG_ERROR("Input log version {} is not supported, expected {}.", version, INPUT_LOG_VERSION);
+        return false;
+    }
+
+    if (!_start->deserialize(data.data() + INPUT_LOG_HEADER_SIZE, state_size))
+        return false;
+
+    const uint8_t *in = data.data() + header;
+    uint32_t count;
+    in = get_le(in, _end_instruction);
+    in = get_le(in, _end_hash);
+    in = get_le(in, count);
+
+    if (data.size() != header + 20 + (size_t)count * INPUT_LOG_EVENT_SIZE) {
+        SPDLOG_ERROR("Input log '{}' is truncated.", path);
+        return false;
+    }
+
+    _events.resize(count);
+    for (Event &event : _events) {
+        in = get_le(in, event.instruction);
+        event.type = *in++ == (uint8_t)Type::keys ? Type::keys : Type::timers;
+        in = get_le(in, event.keys);
+    }
+
+    _recording = false;
+    return true;
+}
+
+} // namespace tools::chip8
@@ -0,0 +1,91 @@
+#ifndef INPUTLOG_HPP
+#define INPUTLOG_HPP
+
+#include "Chip8.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tools::chip8 {
+
+/**
+ * Everything a run depends on besides the rom : the starting state,
+ * random generator included, then the key changes and timer ticks
+ * at the instruction count they happened.
+ *
+ * Replaying a log runs the same instructions between the same events,
+ * which reproduces the recorded run bit for bit whatever the backend and the host.
+ */
+class InputLog {
+    public:
+
+    enum class Type : uint8_t {
+        keys,
+        timers
+    };
+
+    struct Event {
+        // Instructions executed since start().
+        uint64_t instruction;
+        Type type;
+        // Mask of the pressed keys, see Chip8::set_keys().
+        uint16_t keys;
+    };
+
+    InputLog();
+    ~InputLog();
+
+    /**
+     * @brief Start a new log from the current state of cpu.
+     */
+    void start(Chip8 &cpu);
+
+    /**
+     * @brief Record the keys of cpu, call after any key change.
+     */
+    void record_keys(Chip8 &cpu);
+
+    /**
+     * @brief Record a call to cpu.decrease_timers().
+     */
+    void record_timers(Chip8 &cpu);
+
+    /**
+     * @brief Record the end of the run, replay() checks the state it reaches.
+     */
+    void stop(Chip8 &cpu);
+
+    bool is_recording();
+
+    /**
+     * @brief Restore the starting state into cpu and replay the events.
+     * cpu must have the quirks of the recorded run, memory comes with the starting state.
+     * @return false if the final state differs from the recorded one.
+     */
+    bool replay(Chip8 &cpu);
+
+    const std::vector<Event> &get_events();
+
+    bool save(const std::string &path);
+    bool load(const std::string &path);
+
+    private:
+
+    // Run cpu until it executed instruction instructions since the start.
+    bool run_to(Chip8 &cpu, uint64_t base, uint64_t instruction);
+
+    std::unique_ptr<Chip8::State> _start;
+    std::vector<Event> _events;
+
+    // Instructions of cpu when the log started.
+    uint64_t _base = 0;
+    bool _recording = false;
+
+    uint64_t _end_instruction = 0;
+    uint64_t _end_hash = 0;
+};
+
+} // namespace tools::chip8
+
+#endif // INPUTLOG_HPP
@@ -0,0 +1,301 @@
+#include "Jit.hpp"
+#include "Chip8.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X86_64
+#endif
+
+#ifdef WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// x86-64 register usage inside a block :
+// rdi = V registers, rsi = I, al and cl = scratch, eax = next pc on return.
+// ModRM bytes below address [rdi + disp8] (mod = 01, rm = 111).
+#define MODRM_RDI_DISP8(reg) (0x47 | ((reg) << 3))
+#define REG_AL 0
+#define REG_CL 1
+
+namespace tools::chip8 {
+
+Jit::Jit() {
+    #ifdef JIT_X86_64
+    #ifdef WINDOWS
+    _code = static_cast<uint8_t *>(VirtualAlloc(nullptr, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+    #else
+    void *code = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    _code = code == MAP_FAILED ? nullptr : static_cast<uint8_t *>(code);
+    #endif
+    if (!_code)
+        SPDLOG_ERROR("Failed to allocate executable memory, JIT disabled.");
+    #endif
+
+    flush();
+}
+
+Jit::~Jit() {
+    if (!_code)
+        return;
+
+    #ifdef WINDOWS
+    VirtualFree(_code, 0, MEM_RELEASE);
+    #else
+    munmap(_code, CODE_SIZE);
+    #endif
+}
+
+bool Jit::is_available() {
+    return _code != nullptr;
+}
+
+void Jit::invalidate(uint16_t addr) {
+    addr &= ADDRESSES - 1;
+    if (_translated[addr]) {
+        flush();
+        return;
+    }
+
+    // The instructions starting at addr and before it may translate now.
+    _tried[addr] = false;
+    _tried[(addr - 1) & (ADDRESSES - 1)] = false;
+}
+
+void Jit::set_quirks(const Quirks &quirks) {
+    _quirks = quirks;
+    flush();
+}
+
+void Jit::flush() {
+    memset(_blocks, 0, sizeof(_blocks));
+    _tried.reset();
+    _translated.reset();
+    _code_used = 0;
+}
+
+bool Jit::translate(uint16_t addr, const uint8_t *const *pages) {
+    // Worst case block size, see emit_instruction().
+    if (_code_used + (MAX_BLOCK_LENGTH + 1) * 24 > CODE_SIZE) {
+        flush();
+        _tried[addr] = true;
+    }
+
+    size_t start = _code_used;
+
+    #ifdef WINDOWS
+    // Windows x64 passes arguments in rcx and rdx, and rdi / rsi are callee-saved.
+    emit8(0x57);                            // push rdi
+    emit8(0x56);                            // push rsi
+    emit8(0x48); emit8(0x89); emit8(0xcf);  // mov rdi, rcx
+    emit8(0x48); emit8(0x89); emit8(0xd6);  // mov rsi, rdx
+    #endif
+
+    uint16_t length = 0;
+    uint16_t pc = addr;
+    bool exited = false;
+    while (length < MAX_BLOCK_LENGTH && pc + 1 < MEMORY_SIZE) {
+        uint16_t opcode = (pages[pc >> 8][pc & 0xff] << 8) | pages[(pc + 1) >> 8][(pc + 1) & 0xff];
+        if (emit_exit(opcode, pc)) {
+            exited = true;
+            ++length;
+            pc += 2;
+            break;
+        }
+        if (!emit_instruction(opcode))
+            break;
+        ++length;
+        pc += 2;
+    }
+
+    if (length < MIN_BLOCK_LENGTH) {
+        _code_used = start;
+        return false;
+    }
+
+    // Fall through to the instruction left to the interpreter.
+    if (!exited) {
+        emit8(0xb8); emit32(pc);                                                    // mov eax, pc
+    }
+
+    #ifdef WINDOWS
+    emit8(0x5e);    // pop rsi
+    emit8(0x5f);    // pop rdi
+    #endif
+    emit8(0xc3);    // ret
+
+    for (uint16_t i = addr ; i < pc ; ++i)
+        _translated[i] = true;
+
+    _blocks[addr].code = reinterpret_cast<Code>(_code + start);
+    _blocks[addr].length = length;
+    return true;
+}
+
+bool Jit::emit_exit(uint16_t opcode, uint16_t pc) {
+    uint8_t x = (opcode >> 8) & 0x000f;
+    uint8_t y = (opcode >> 4) & 0x000f;
+    uint8_t const8 = opcode & 0x00ff;
+    uint16_t addr = opcode & 0x0fff;
+
+    // Flags of the comparison pick the next pc, taken when the skip condition holds.
+    uint8_t cmov;
+    switch (opcode >> 12) {
+        case 0x1:
+            // Jumps to themselves or back to a Fx07 3x00 loop raise events in the interpreter.
+            if (addr == pc || addr == pc - 4)
+                return false;
+            emit8(0xb8); emit32(addr);                                              // mov eax, nnn
+            return true;
+
+        case 0x3:
+        case 0x4:
+            emit8(0x80); emit8(MODRM_RDI_DISP8(7)); emit8(x); emit8(const8);       // cmp byte [rdi + x], nn
+            cmov = (opcode >> 12) == 0x3 ? 0x44 : 0x45;                             // cmove, cmovne
+            break;
+
+        case 0x5:
+        case 0x9:
+            if ((opcode & 0x000f) != 0)
+                return false;
+            emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(y);                 // mov al, [rdi + y]
+            emit8(0x38); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);                 // cmp [rdi + x], al
+            cmov = (opcode >> 12) == 0x5 ? 0x44 : 0x45;                             // cmove, cmovne
+            break;
+
+        default:
+            return false;
+    }
+
+    // mov does not change the flags.
+    emit8(0xb8); emit32(pc + 2);                                                    // mov eax, pc + 2
+    emit8(0xb9); emit32(pc + 4);                                                    // mov ecx, pc + 4
+    emit8(0x0f); emit8(cmov); emit8(0xc1);                                          // cmovcc eax, ecx
+    return true;
+}
+
+bool Jit::emit_instruction(uint16_t opcode) {
+    uint8_t x = (opcode >> 8) & 0x000f;
+    uint8_t y = (opcode >> 4) & 0x000f;
+    uint8_t const8 = opcode & 0x00ff;
+    uint16_t addr = opcode & 0x0fff;
+
+    // Stores follow the same order as the interpreter
+    // so that VF ends up identical when x == 0xf.
+    switch (opcode >> 12) {
+        case 0x6:
+            emit8(0xc6); emit8(MODRM_RDI_DISP8(0)); emit8(x); emit8(const8);       // mov byte [rdi + x], nn
+            return true;
+
+        case 0x7:
+            emit8(0x80); emit8(MODRM_RDI_DISP8(0)); emit8(x); emit8(const8);       // add byte [rdi + x], nn
+            return true;
+
+        case 0x8:
+            switch (opcode & 0x000f) {
+                case 0x0:
+                    emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(y);         // mov al, [rdi + y]
+                    emit8(0x88); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);         // mov [rdi + x], al
+                    return true;
+                case 0x1:
+                case 0x2:
+                case 0x3: {
+                    // or, and, xor [rdi + x], al
+                    static const uint8_t ops[] = { 0x08, 0x20, 0x30 };
+                    emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(y);         // mov al, [rdi + y]
+                    emit8(ops[(opcode & 0x000f) - 1]); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);
+                    if (_quirks.vf_reset) {
+                        emit8(0xc6); emit8(MODRM_RDI_DISP8(0)); emit8(0xf); emit8(0x00);  // mov byte [rdi + 0xf], 0
+                    }
+                    return true;
+                }
+                case 0x4:
+                    emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);         // mov al, [rdi + x]
+                    emit8(0x02); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(y);         // add al, [rdi + y]
+                    emit8(0x0f); emit8(0x92); emit8(0xc1);                          // setc cl
+                    emit8(0x88); emit8(MODRM_RDI_DISP8(REG_CL)); emit8(0xf);       // mov [rdi + 0xf], cl
+                    emit8(0x88); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);         // mov [rdi + x], al
+                    return true;
+                case 0x5:
+                case 0x7: {
+                    // VF is written before the subtraction reads its operands.
+                    uint8_t lhs = (opcode & 0x000f) == 0x5 ? x : y;
+                    uint8_t rhs = (opcode & 0x000f) == 0x5 ? y : x;
+                    emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(lhs);       // mov al, [rdi + lhs]
+                    emit8(0x3a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(rhs);       // cmp al, [rdi + rhs]
+                    emit8(0x0f); emit8(0x93); emit8(0xc1);                          // setnc cl
+                    emit8(0x88); emit8(MODRM_RDI_DISP8(REG_CL)); emit8(0xf);       // mov [rdi + 0xf], cl
+                    emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(lhs);       // mov al, [rdi + lhs]
+                    emit8(0x2a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(rhs);       // sub al, [rdi + rhs]
+                    emit8(0x88); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);         // mov [rdi + x], al
+                    return true;
+                }
+                case 0x6:
+                    if (_quirks.shift_vy) {
+                        emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(y);     // mov al, [rdi + y]
+                        emit8(0x88); emit8(0xc1);                                   // mov cl, al
+                        emit8(0x80); emit8(0xe1); emit8(0x01);                      // and cl, 1
+                        emit8(0x88); emit8(MODRM_RDI_DISP8(REG_CL)); emit8(0xf);   // mov [rdi + 0xf], cl
+                        emit8(0xd0); emit8(0xe8);                                   // shr al, 1
+                        emit8(0x88); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);     // mov [rdi + x], al
+                        return true;
+                    }
+                    emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);         // mov al, [rdi + x]
+                    emit8(0x24); emit8(0x01);                                       // and al, 1
+                    emit8(0x88); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(0xf);       // mov [rdi + 0xf], al
+                    emit8(0xd0); emit8(MODRM_RDI_DISP8(5)); emit8(x);              // shr byte [rdi + x], 1
+                    return true;
+                case 0xe:
+                    if (_quirks.shift_vy) {
+                        emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(y);     // mov al, [rdi + y]
+                        emit8(0x88); emit8(0xc1);                                   // mov cl, al
+                        emit8(0xc0); emit8(0xe9); emit8(0x07);                      // shr cl, 7
+                        emit8(0x88); emit8(MODRM_RDI_DISP8(REG_CL)); emit8(0xf);   // mov [rdi + 0xf], cl
+                        emit8(0xd0); emit8(0xe0);                                   // shl al, 1
+                        emit8(0x88); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);     // mov [rdi + x], al
+                        return true;
+                    }
+                    emit8(0x8a); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);         // mov al, [rdi + x]
+                    emit8(0xc0); emit8(0xe8); emit8(0x07);                          // shr al, 7
+                    emit8(0x88); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(0xf);       // mov [rdi + 0xf], al
+                    emit8(0xd0); emit8(MODRM_RDI_DISP8(4)); emit8(x);              // shl byte [rdi + x], 1
+                    return true;
+                default:
+                    return false;
+            }
+
+        case 0xa:
+            emit8(0x66); emit8(0xc7); emit8(0x06); emit16(addr);                    // mov word [rsi], nnn
+            return true;
+
+        case 0xf:
+            if (const8 != 0x1e)
+                return false;
+            emit8(0x0f); emit8(0xb6); emit8(MODRM_RDI_DISP8(REG_AL)); emit8(x);    // movzx eax, byte [rdi + x]
+            emit8(0x66); emit8(0x01); emit8(0x06);                                  // add [rsi], ax
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void Jit::emit8(uint8_t byte) {
+    _code[_code_used++] = byte;
+}
+
+void Jit::emit16(uint16_t word) {
+    emit8(word & 0xff);
+    emit8(word >> 8);
+}
+
+void Jit::emit32(uint32_t word) {
+    emit16(word & 0xffff);
+    emit16(word >> 16);
+}
+
+} // namespace tools::chip8
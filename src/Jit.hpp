@@ -0,0 +1,108 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+#include "Quirks.hpp"
+
+namespace tools::chip8 {
+
+/**
+ * Translates straight-line runs of chip8 instructions into x86-64 code.
+ * A block ends with a jump or a skip, which it executes and leaves to,
+ * or stops before the first instruction the JIT does not handle
+ * (calls, draw, timers, memory accesses...), which is left to the interpreter.
+ */
+class Jit {
+    public:
+
+    // Compiled block, called with the V registers and I.
+    // Returns the address of the next instruction to execute.
+    using Code = uint16_t (*)(uint8_t *v, uint16_t *i);
+
+    struct Block {
+        Code code;
+        // Number of chip8 instructions executed by code.
+        uint16_t length;
+    };
+
+    Jit();
+    ~Jit();
+
+    /**
+     * @brief Whether executable memory is available on this host.
+     */
+    bool is_available();
+
+    /**
+     * @brief Get the block starting at addr, translating it if needed.
+     * @param addr Address of the first instruction of the block.
+     * @param pages Chip8 memory, MEMORY_PAGES pages of MEMORY_PAGE_SIZE bytes.
+     * @return The block or nullptr if the instruction at addr cannot be translated.
+     */
+    const Block *find(uint16_t addr, const uint8_t *const *pages) {
+        // Called before every instruction the blocks leave to the interpreter.
+        addr &= ADDRESSES - 1;
+        if (!_tried[addr]) [[unlikely]] {
+            _tried[addr] = true;
+            if (_code)
+                translate(addr, pages);
+        }
+        return _blocks[addr].code ? &_blocks[addr] : nullptr;
+    }
+
+    /**
+     * @brief Drop all blocks if addr is part of a translated range,
+     * otherwise retry translating the instruction at addr when reached.
+     */
+    void invalidate(uint16_t addr);
+
+    /**
+     * @brief Drop all blocks.
+     */
+    void flush();
+
+    /**
+     * @brief Translate following these quirks, drops all blocks.
+     */
+    void set_quirks(const Quirks &quirks);
+
+    private:
+
+    bool translate(uint16_t addr, const uint8_t *const *pages);
+    bool emit_instruction(uint16_t opcode);
+
+    // Emit a jump or a skip at pc ending the block.
+    // @return false if the instruction is not one or must be left to the interpreter.
+    bool emit_exit(uint16_t opcode, uint16_t pc);
+
+    void emit8(uint8_t byte);
+    void emit16(uint16_t word);
+    void emit32(uint32_t word);
+
+    // Mapped by every machine, blocks are dropped and translated again when full.
+    static constexpr size_t CODE_SIZE = 64 * 1024;
+    static constexpr uint16_t MAX_BLOCK_LENGTH = 64;
+    // Shorter blocks cost more to enter than to interpret.
+    static constexpr uint16_t MIN_BLOCK_LENGTH = 2;
+    static constexpr size_t ADDRESSES = 0x1000;
+
+    Quirks _quirks;
+
+    uint8_t *_code = nullptr;
+    size_t _code_used = 0;
+
+    Block _blocks[ADDRESSES];
+
+    // Addresses for which translation was attempted.
+    std::bitset<ADDRESSES> _tried;
+
+    // Addresses read by a translated block.
+    std::bitset<ADDRESSES> _translated;
+};
+
+} // namespace tools::chip8
+
+#endif // JIT_HPP
@@ -0,0 +1,415 @@
+#include "Lockstep.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace tools::chip8 {
+
+namespace {
+
+// Operations on one byte per lane.
+#ifdef __AVX2__
+
+using Vec = __m256i;
+
+inline Vec load(const uint8_t *lanes) { return _mm256_load_si256((const __m256i *)lanes); }
+inline void store(uint8_t *lanes, Vec a) { _mm256_store_si256((__m256i *)lanes, a); }
+inline Vec splat(uint8_t value) { return _mm256_set1_epi8(value); }
+
+inline Vec add(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+inline Vec bit_or(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+inline Vec bit_and(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+inline Vec bit_xor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+inline Vec shr1(Vec a) { return _mm256_and_si256(_mm256_srli_epi16(a, 1), splat(0x7f)); }
+
+// 0xff where the comparison holds, 0 elsewhere.
+inline Vec eq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vec ge(Vec a, Vec b) { return _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a); }
+
+// One bit per lane.
+inline uint32_t bits(Vec mask) { return _mm256_movemask_epi8(mask); }
+
+// I = value
+inline void set_i(uint16_t *i, uint16_t value) {
+    __m256i all = _mm256_set1_epi16(value);
+    _mm256_store_si256((__m256i *)i, all);
+    _mm256_store_si256((__m256i *)(i + 16), all);
+}
+
+// I = I + V * scale, or V * scale when add is false.
+inline void update_i(uint16_t *i, const uint8_t *v, uint16_t scale, bool add) {
+    for (int half = 0 ; half < 2 ; ++half) {
+        __m256i wide = _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)(v + 16 * half)));
+        wide = _mm256_mullo_epi16(wide, _mm256_set1_epi16(scale));
+        if (add)
+            wide = _mm256_add_epi16(wide, _mm256_load_si256((const __m256i *)(i + 16 * half)));
+        _mm256_store_si256((__m256i *)(i + 16 * half), wide);
+    }
+}
+
+#else
+
+struct Vec {
+    uint8_t lanes[Lockstep::LANES];
+};
+
+template <typename Operation>
+inline Vec map(Vec a, Vec b, Operation operation) {
+    Vec result;
+    for (int lane = 0 ; lane < Lockstep::LANES ; ++lane)
+        result.lanes[lane] = operation(a.lanes[lane], b.lanes[lane]);
+    return result;
+}
+
+inline Vec load(const uint8_t *lanes) { Vec a; memcpy(a.lanes, lanes, sizeof(a.lanes)); return a; }
+inline void store(uint8_t *lanes, Vec a) { memcpy(lanes, a.lanes, sizeof(a.lanes)); }
+inline Vec splat(uint8_t value) { Vec a; memset(a.lanes, value, sizeof(a.lanes)); return a; }
+
+inline Vec add(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) -> uint8_t { return x + y; }); }
+inline Vec sub(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) -> uint8_t { return x - y; }); }
+inline Vec bit_or(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) -> uint8_t { return x | y; }); }
+inline Vec bit_and(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) -> uint8_t { return x & y; }); }
+inline Vec bit_xor(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) -> uint8_t { return x ^ y; }); }
+inline Vec shr1(Vec a) { return map(a, a, [](uint8_t x, uint8_t) -> uint8_t { return x >> 1; }); }
+
+inline Vec eq(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) -> uint8_t { return x == y ? 0xff : 0; }); }
+inline Vec ge(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) -> uint8_t { return x >= y ? 0xff : 0; }); }
+
+inline uint32_t bits(Vec mask) {
+    uint32_t result = 0;
+    for (int lane = 0 ; lane < Lockstep::LANES ; ++lane)
+        result |= (uint32_t)(mask.lanes[lane] >> 7) << lane;
+    return result;
+}
+
+inline void set_i(uint16_t *i, uint16_t value) {
+    for (int lane = 0 ; lane < Lockstep::LANES ; ++lane)
+        i[lane] = value;
+}
+
+inline void update_i(uint16_t *i, const uint8_t *v, uint16_t scale, bool add) {
+    for (int lane = 0 ; lane < Lockstep::LANES ; ++lane)
+        i[lane] = (add ? i[lane] : 0) + v[lane] * scale;
+}
+
+#endif
+
+// 1 where the comparison holds, 0 elsewhere.
+inline Vec flag(Vec mask) { return bit_and(mask, splat(1)); }
+
+} // namespace
+
+Lockstep::Lockstep() {}
+Lockstep::~Lockstep() {}
+
+uint64_t Lockstep::get_lockstep_count() {
+    return _lockstep_count;
+}
+
+bool Lockstep::blocks(Chip8::StopReason reason) {
+    return reason == Chip8::StopReason::idle
+        || reason == Chip8::StopReason::waiting_for_key
+        || reason == Chip8::StopReason::halt_loop;
+}
+
+void Lockstep::run(Chip8 *const *cpus, int count, const uint32_t *budgets, Chip8::RunResult *results) {
+    _cpus = cpus;
+    _budgets = budgets;
+    _results = results;
+    _count = std::min(count, LANES);
+    _stopped = 0;
+    _same_code.reset();
+
+    uint32_t lanes = 0;
+    for (int lane = 0 ; lane < _count ; ++lane) {
+        _results[lane] = { 0, Chip8::StopReason::budget };
+        if (_budgets[lane] > 0)
+            lanes |= 1u << lane;
+    }
+
+    gather(lanes);
+
+    while (_active) {
+        // Lanes left alone or at the end of the address space run by themselves.
+        if (_executed >= _budget || std::popcount(_active) < 2
+            || _pc + 1 >= MEMORY_SIZE || !same_code(_pc)) {
+            scatter(_active);
+            break;
+        }
+
+        uint16_t opcode = _cpus[std::countr_zero(_active)]->read_opcode(_pc);
+
+        if (supported(opcode)) {
+            ++_executed;
+            _lockstep_count += std::popcount(_active);
+            execute(opcode);
+        }
+        else {
+            step_lanes(opcode);
+        }
+    }
+
+    for (int lane = 0 ; lane < _count ; ++lane) {
+        if (!(_stopped & (1u << lane)))
+            finish(lane);
+    }
+}
+
+void Lockstep::gather(uint32_t mask) {
+    _active = 0;
+    _executed = 0;
+    _budget = UINT32_MAX;
+    if (mask == 0)
+        return;
+
+    const Chip8 &leader = *_cpus[std::countr_zero(mask)];
+    _pc = leader._pc;
+    _sp = leader._sp;
+    _quirks = leader._quirks;
+    memcpy(_stack, leader._stack, sizeof(_stack));
+
+    for (uint32_t rest = mask ; rest ; rest &= rest - 1) {
+        int lane = std::countr_zero(rest);
+        const Chip8 &cpu = *_cpus[lane];
+
+        // Tracing and breakpoints need the machine to see every instruction.
+        if (cpu._pc != _pc || cpu._sp != _sp || cpu._single_step || !(cpu._quirks == _quirks)
+            || memcmp(cpu._stack, _stack, _sp * sizeof(uint16_t)) != 0)
+            continue;
+
+        for (int r = 0 ; r < REGISTERS_SIZE ; ++r)
+            _v[r][lane] = cpu._v[r];
+        _i[lane] = cpu._i;
+        _delay[lane] = cpu._delay_timer;
+
+        _active |= 1u << lane;
+        _budget = std::min(_budget, _budgets[lane] - _results[lane].executed);
+    }
+}
+
+void Lockstep::scatter(uint32_t mask) {
+    for (uint32_t rest = mask ; rest ; rest &= rest - 1) {
+        int lane = std::countr_zero(rest);
+        Chip8 &cpu = *_cpus[lane];
+
+        for (int r = 0 ; r < REGISTERS_SIZE ; ++r)
+            cpu._v[r] = _v[r][lane];
+        cpu._i = _i[lane];
+        cpu._delay_timer = _delay[lane];
+        cpu._pc = _pc;
+        cpu._sp = _sp;
+        memcpy(cpu._stack, _stack, _sp * sizeof(uint16_t));
+
+        _results[lane].executed += _executed;
+        cpu._instructions += _executed;
+    }
+}
+
+bool Lockstep::same_code(uint16_t addr) {
+    if (_same_code[addr])
+        return true;
+
+    Chip8 &leader = *_cpus[std::countr_zero(_active)];
+    uint16_t opcode = leader.read_opcode(addr);
+    for (uint32_t rest = _active ; rest ; rest &= rest - 1) {
+        Chip8 &cpu = *_cpus[std::countr_zero(rest)];
+        // Lanes usually share the rom pages.
+        if (cpu._pages[addr >> 8] == leader._pages[addr >> 8]
+            && cpu._pages[(addr + 1) >> 8] == leader._pages[(addr + 1) >> 8])
+            continue;
+        if (cpu.read_opcode(addr) != opcode)
+            return false;
+    }
+
+    _same_code[addr] = true;
+    return true;
+}
+
+bool Lockstep::supported(uint16_t opcode) {
+    switch (opcode >> 12) {
+        case 0x0: return opcode == 0x00ee && _sp > 0;
+        case 0x1: {
+            // Jumps raising halt_loop or idle are left to the machines.
+            uint16_t addr = opcode & 0x0fff;
+            return addr != _pc && addr != _pc - 4;
+        }
+        case 0x2: return _sp < STACK_SIZE;
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x6:
+        case 0x7:
+        case 0x9:
+        case 0xa: return true;
+        case 0x8:
+            switch (opcode & 0x000f) {
+                case 0x0: case 0x1: case 0x2: case 0x3:
+                case 0x4: case 0x5: case 0x6: case 0x7:
+                case 0xe: return true;
+                default: return false;
+            }
+        case 0xf:
+            switch (opcode & 0x00ff) {
+                case 0x07: case 0x15: case 0x1e: case 0x29: return true;
+                default: return false;
+            }
+        default: return false;
+    }
+}
+
+void Lockstep::execute(uint16_t opcode) {
+    uint8_t *vx = _v[(opcode >> 8) & 0x000f];
+    uint8_t *vy = _v[(opcode >> 4) & 0x000f];
+    uint8_t *vf = _v[0xf];
+    uint8_t const8 = opcode & 0x00ff;
+    uint16_t addr = opcode & 0x0fff;
+
+    // Same order of reads and writes as the Chip8 handlers,
+    // so that X or Y being F gives the same result.
+    _pc += 2;
+    switch (opcode >> 12) {
+        case 0x0: _pc = _stack[--_sp]; break;
+        case 0x1: _pc = addr; break;
+        case 0x2: _stack[_sp++] = _pc; _pc = addr; break;
+        case 0x3: skip(bits(eq(load(vx), splat(const8)))); break;
+        case 0x4: skip(~bits(eq(load(vx), splat(const8)))); break;
+        case 0x5: skip(bits(eq(load(vx), load(vy)))); break;
+        case 0x6: store(vx, splat(const8)); break;
+        case 0x7: store(vx, add(load(vx), splat(const8))); break;
+        case 0x8: {
+            Vec a = load(vx);
+            Vec b = load(vy);
+            switch (opcode & 0x000f) {
+                case 0x0: store(vx, b); break;
+                case 0x1: store(vx, bit_or(a, b)); break;
+                case 0x2: store(vx, bit_and(a, b)); break;
+                case 0x3: store(vx, bit_xor(a, b)); break;
+                case 0x4:
+                    // Carry when a > 0xff - b.
+                    store(vf, bit_xor(flag(ge(bit_xor(b, splat(0xff)), a)), splat(1)));
+                    store(vx, add(a, b));
+                    break;
+                case 0x5:
+                    store(vf, flag(ge(a, b)));
+                    store(vx, sub(load(vx), load(vy)));
+                    break;
+                case 0x6:
+                    if (_quirks.shift_vy) {
+                        store(vf, bit_and(b, splat(1)));
+                        store(vx, shr1(b));
+                    }
+                    else {
+                        store(vf, bit_and(a, splat(1)));
+                        store(vx, shr1(load(vx)));
+                    }
+                    break;
+                case 0x7:
+                    store(vf, flag(ge(b, a)));
+                    store(vx, sub(load(vy), load(vx)));
+                    break;
+                case 0xe:
+                    if (_quirks.shift_vy) {
+                        store(vf, flag(ge(b, splat(0x80))));
+                        store(vx, add(b, b));
+                    }
+                    else {
+                        store(vf, flag(ge(a, splat(0x80))));
+                        a = load(vx);
+                        store(vx, add(a, a));
+                    }
+                    break;
+                default: break;
+            }
+
+            uint8_t op = opcode & 0x000f;
+            if (_quirks.vf_reset && op >= 0x1 && op <= 0x3)
+                store(vf, splat(0));
+            break;
+        }
+        case 0x9: skip(~bits(eq(load(vx), load(vy)))); break;
+        case 0xa: set_i(_i, addr); break;
+        case 0xf:
+            switch (const8) {
+                case 0x07: store(vx, load(_delay)); break;
+                case 0x15: store(_delay, load(vx)); break;
+                case 0x1e: update_i(_i, vx, 1, true); break;
+                case 0x29: update_i(_i, vx, 5, false); break;
+                default: break;
+            }
+            break;
+        default: break;
+    }
+}
+
+void Lockstep::skip(uint32_t taken) {
+    taken &= _active;
+    uint32_t not_taken = _active & ~taken;
+
+    if (not_taken == 0) {
+        _pc += 2;
+        return;
+    }
+    if (taken == 0)
+        return;
+
+    // The smaller side leaves the group and continues alone.
+    if (std::popcount(taken) >= std::popcount(not_taken)) {
+        scatter(not_taken);
+        _active = taken;
+        _pc += 2;
+    }
+    else {
+        _pc += 2;
+        scatter(taken);
+        _pc -= 2;
+        _active = not_taken;
+    }
+}
+
+void Lockstep::step_lanes(uint16_t opcode) {
+    uint32_t lanes = _active;
+    scatter(lanes);
+
+    for (uint32_t rest = lanes ; rest ; rest &= rest - 1) {
+        int lane = std::countr_zero(rest);
+        Chip8::RunResult result = _cpus[lane]->run(1);
+        _results[lane].executed += result.executed;
+
+        if (blocks(result.reason)) {
+            _results[lane].reason = result.reason;
+            _stopped |= 1u << lane;
+        }
+        else if (_results[lane].executed >= _budgets[lane]) {
+            _stopped |= 1u << lane;
+        }
+    }
+
+    // Fx33 and Fx55 may have written different values on each lane.
+    uint16_t kind = opcode & 0xf0ff;
+    if (kind == 0xf033 || kind == 0xf055)
+        _same_code.reset();
+
+    gather(lanes & ~_stopped);
+}
+
+void Lockstep::finish(int lane) {
+    Chip8 &cpu = *_cpus[lane];
+    Chip8::RunResult &result = _results[lane];
+
+    while (result.executed < _budgets[lane]) {
+        Chip8::RunResult step = cpu.run(_budgets[lane] - result.executed);
+        result.executed += step.executed;
+        if (blocks(step.reason)) {
+            result.reason = step.reason;
+            return;
+        }
+    }
+}
+
+} // namespace tools::chip8
@@ -0,0 +1,100 @@
+#ifndef LOCKSTEP_HPP
+#define LOCKSTEP_HPP
+
+#include <bitset>
+#include <cstdint>
+
+#include "Chip8.hpp"
+
+namespace tools::chip8 {
+
+/**
+ * @brief Runs up to LANES machines sharing a rom as one, while their pc agree.
+ * V, I and the delay timer live in structure of arrays form, one byte or word
+ * per machine, and register instructions execute on every lane at once
+ * (AVX2 when built with CHIP8_AVX2).
+ * Lanes leave the group when a skip splits them, the smaller side continues
+ * alone with Chip8::run(). Instructions touching memory, the screen, keys,
+ * sound or random numbers are executed by each machine, after which lanes
+ * with the same pc and stack are grouped again.
+ */
+class Lockstep {
+    public:
+
+    static constexpr int LANES = 32;
+
+    Lockstep();
+    ~Lockstep();
+
+    /**
+     * @brief Run every machine as repeated Chip8::run() calls would, until its
+     * budget is spent or it stops on StopReason::idle, waiting_for_key or halt_loop.
+     * Other stop reasons are not reported.
+     * @param cpus Up to LANES machines.
+     * @param budgets Budget of each machine.
+     * @param results Filled with the instructions executed by each machine
+     * and the stop reason, StopReason::budget if it used its budget.
+     */
+    void run(Chip8 *const *cpus, int count, const uint32_t *budgets, Chip8::RunResult *results);
+
+    /**
+     * @return Instructions executed in lockstep since construction, counted once per lane.
+     */
+    uint64_t get_lockstep_count();
+
+    private:
+
+    // Group the lanes of mask agreeing with the first one, load their registers.
+    void gather(uint32_t mask);
+
+    // Write the registers of the lanes of mask back to their machine.
+    void scatter(uint32_t mask);
+
+    bool same_code(uint16_t addr);
+    bool supported(uint16_t opcode);
+    void execute(uint16_t opcode);
+    void skip(uint32_t taken);
+
+    // Execute one instruction on each lane alone.
+    void step_lanes(uint16_t opcode);
+
+    // Run a lane alone until it spends its budget or blocks.
+    void finish(int lane);
+
+    // Stops ending the run of a lane.
+    static bool blocks(Chip8::StopReason reason);
+
+    // One row per register, one column per lane.
+    alignas(32) uint8_t _v[REGISTERS_SIZE][LANES];
+    alignas(32) uint16_t _i[LANES];
+    alignas(32) uint8_t _delay[LANES];
+
+    // Shared by the grouped lanes.
+    uint16_t _pc;
+    uint16_t _stack[STACK_SIZE];
+    uint8_t _sp;
+    Quirks _quirks;
+
+    // Grouped lanes.
+    uint32_t _active;
+    // Lanes done with their budget or blocked.
+    uint32_t _stopped;
+
+    // Executed by the group since the last gather(), and how many it may execute.
+    uint32_t _executed;
+    uint32_t _budget;
+
+    // Addresses holding the same opcode on every lane, see same_code().
+    std::bitset<MEMORY_SIZE> _same_code;
+
+    Chip8 *const *_cpus;
+    const uint32_t *_budgets;
+    Chip8::RunResult *_results;
+    int _count;
+
+    uint64_t _lockstep_count = 0;
+};
+
+} // namespace tools::chip8
+
+#endif // LOCKSTEP_HPP
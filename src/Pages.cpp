@@ -0,0 +1,107 @@
+#include "Pages.hpp"
+
+#include "Chip8.hpp"
+
+#include <cstring>
+
+#define FONTSET_SIZE 80
+const unsigned char fontset[FONTSET_SIZE] = {
+	0xF0, 0x90, 0x90, 0x90, 0xF0,		// 0
+	0x20, 0x60, 0x20, 0x20, 0x70,		// 1
+	0xF0, 0x10, 0xF0, 0x80, 0xF0,		// 2
+	0xF0, 0x10, 0xF0, 0x10, 0xF0,		// 3
+	0x90, 0x90, 0xF0, 0x10, 0x10,		// 4
+	0xF0, 0x80, 0xF0, 0x10, 0xF0,		// 5
+	0xF0, 0x80, 0xF0, 0x90, 0xF0,		// 6
+	0xF0, 0x10, 0x20, 0x40, 0x40,		// 7
+	0xF0, 0x90, 0xF0, 0x90, 0xF0,		// 8
+	0xF0, 0x90, 0xF0, 0x10, 0xF0,		// 9
+	0xF0, 0x90, 0xF0, 0x90, 0x90,		// A
+	0xE0, 0x90, 0xE0, 0x90, 0xE0,		// B
+	0xF0, 0x80, 0x80, 0x80, 0xF0,		// C
+	0xE0, 0x90, 0x90, 0x90, 0xE0,		// D
+	0xF0, 0x80, 0xF0, 0x80, 0xF0,		// E
+	0xF0, 0x80, 0xF0, 0x80, 0x80		// F
+};
+
+namespace tools::chip8 {
+
+PageArena::PageArena() {}
+PageArena::~PageArena() {}
+
+std::shared_ptr<PageArena> PageArena::shared() {
+    static std::shared_ptr<PageArena> arena = std::make_shared<PageArena>();
+    return arena;
+}
+
+Page *PageArena::allocate() {
+    std::lock_guard lock(_mutex);
+
+    if (_free.empty()) {
+        _blocks.push_back(std::make_unique<Page[]>(BLOCK_PAGES));
+        Page *block = _blocks.back().get();
+        for (size_t i = BLOCK_PAGES ; i > 0 ; --i)
+            _free.push_back(block + i - 1);
+    }
+
+    Page *page = _free.back();
+    _free.pop_back();
+    ++_allocated;
+    return page;
+}
+
+void PageArena::release(Page *page) {
+    std::lock_guard lock(_mutex);
+    _free.push_back(page);
+    --_allocated;
+}
+
+size_t PageArena::get_allocated() {
+    std::lock_guard lock(_mutex);
+    return _allocated;
+}
+
+std::shared_ptr<RomImage> RomImage::create(const std::vector<uint8_t> &rom) {
+    if (rom.size() > PROGRAM_SIZE)
+        return nullptr;
+
+    auto image = std::make_shared<RomImage>();
+    uint8_t *memory = image->_memory;
+    memset(memory, 0, MEMORY_SIZE);
+    memcpy(memory, fontset, FONTSET_SIZE);
+    image->write_rom(rom.data(), rom.size());
+
+    return image;
+}
+
+bool RomImage::write_rom(const uint8_t *rom, size_t size) {
+    if (size > PROGRAM_SIZE)
+        return false;
+
+    uint8_t *program = _memory + PROGRAM_START;
+    if (size > 0)
+        memcpy(program, rom, size);
+    if (_rom_size > size)
+        memset(program + size, 0, _rom_size - size);
+
+    _rom_size = size;
+
+    // Machines mapping the image start from this hash, see Chip8::load_rom().
+    _hash = 0;
+    for (int addr = 0 ; addr < MEMORY_SIZE ; addr += 8) {
+        uint64_t word;
+        memcpy(&word, _memory + addr, sizeof(word));
+        _hash ^= Chip8::memory_term(addr, word);
+    }
+    return true;
+}
+
+const uint8_t *RomImage::page(int index) const {
+    return _memory + index * MEMORY_PAGE_SIZE;
+}
+
+uint64_t RomImage::get_hash() const {
+    return _hash;
+}
+
+} // namespace tools::chip8
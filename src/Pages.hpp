@@ -0,0 +1,89 @@
+#ifndef PAGES_HPP
+#define PAGES_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Memory is mapped in pages so that machines can share the ones they do not write.
+#define MEMORY_PAGE_SIZE 0x100
+#define MEMORY_PAGES 16
+
+namespace tools::chip8 {
+
+struct alignas(64) Page {
+    uint8_t bytes[MEMORY_PAGE_SIZE];
+};
+
+/**
+ * @brief Pool of writable pages, for machines writing into shared pages.
+ * Pages are allocated in blocks and recycled, blocks are freed with the arena.
+ * Thread safe.
+ */
+class PageArena {
+    public:
+
+    PageArena();
+    ~PageArena();
+
+    /**
+     * @brief Arena used by machines unless told otherwise.
+     */
+    static std::shared_ptr<PageArena> shared();
+
+    Page *allocate();
+    void release(Page *page);
+
+    /**
+     * @return Number of pages in use.
+     */
+    size_t get_allocated();
+
+    private:
+
+    static constexpr size_t BLOCK_PAGES = 256;
+
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<Page[]>> _blocks;
+    std::vector<Page *> _free;
+    size_t _allocated = 0;
+};
+
+/**
+ * @brief Memory content after loading a rom: font, then rom at PROGRAM_START.
+ * Read-only, shared by every machine running the rom.
+ */
+class RomImage {
+    public:
+
+    /**
+     * @return The image, nullptr if the rom does not fit in memory.
+     */
+    static std::shared_ptr<RomImage> create(const std::vector<uint8_t> &rom);
+
+    /**
+     * @brief Replace the rom of an image that no machine maps anymore.
+     * Only the bytes of the previous rom past the new one are cleared.
+     * @return false if the rom does not fit in memory, the image is left as is.
+     */
+    bool write_rom(const uint8_t *rom, size_t size);
+
+    const uint8_t *page(int index) const;
+
+    /**
+     * @return Memory part of Chip8::state_hash() for this image.
+     */
+    uint64_t get_hash() const;
+
+    private:
+
+    // Flat rather than an array of Page, create() and write_rom() span several pages.
+    alignas(64) uint8_t _memory[MEMORY_PAGES * MEMORY_PAGE_SIZE];
+    size_t _rom_size = 0;
+    uint64_t _hash = 0;
+};
+
+} // namespace tools::chip8
+
+#endif // PAGES_HPP
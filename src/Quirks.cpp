@@ -0,0 +1,37 @@
+#include "Quirks.hpp"
+
+namespace tools::chip8 {
+
+namespace {
+
+struct Profile {
+    const char *name;
+    Quirks quirks;
+};
+
+// shift_vy, increment_i, vf_reset, clip, jump_vx
+const Profile profiles[] = {
+    { "default",    { false, true,  false, false, false } },
+    { "chip8",      { true,  true,  true,  true,  false } },
+    { "schip",      { false, false, false, true,  true  } },
+    { "xochip",     { true,  true,  false, false, false } }
+};
+
+} // namespace
+
+std::optional<Quirks> quirks_from_profile(const std::string &name) {
+    for (const auto &profile : profiles) {
+        if (name == profile.name)
+            return profile.quirks;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string> quirks_profiles() {
+    std::vector<std::string> names;
+    for (const auto &profile : profiles)
+        names.push_back(profile.name);
+    return names;
+}
+
+} // namespace tools::chip8
@@ -0,0 +1,47 @@
+#ifndef QUIRKS_HPP
+#define QUIRKS_HPP
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace tools::chip8 {
+
+/**
+ * Behaviours that differ between chip8 implementations.
+ * The defaults match what this interpreter has always done.
+ */
+struct Quirks {
+    // 8xy6 and 8xyE shift VY into VX instead of shifting VX in place.
+    bool shift_vy = false;
+
+    // Fx55 and Fx65 leave I pointing after the last register.
+    bool increment_i = true;
+
+    // 8xy1, 8xy2 and 8xy3 reset VF.
+    bool vf_reset = false;
+
+    // Dxyn clips sprites at the screen edges instead of wrapping them.
+    bool clip = false;
+
+    // Bnnn jumps to VX + nnn (BXnn) instead of V0 + nnn.
+    bool jump_vx = false;
+
+    bool operator==(const Quirks &other) const = default;
+};
+
+/**
+ * @brief Get the quirks of a known profile.
+ * @param name One of quirks_profiles().
+ * @return The quirks, or nothing if the profile is unknown.
+ */
+std::optional<Quirks> quirks_from_profile(const std::string &name);
+
+/**
+ * @brief Names of the known profiles.
+ */
+std::vector<std::string> quirks_profiles();
+
+} // namespace tools::chip8
+
+#endif // QUIRKS_HPP
@@ -0,0 +1,170 @@
+#include "Rewind.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Bytes of the size before and after each record.
+#define RECORD_OVERHEAD 8
+
+namespace tools::chip8 {
+
+namespace {
+
+uint8_t *put_varint(uint8_t *out, size_t value) {
+    while (value >= 0x80) {
+        *out++ = value | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+const uint8_t *get_varint(const uint8_t *in, size_t &value) {
+    value = 0;
+    for (int shift = 0 ; ; shift += 7) {
+        value |= (size_t)(*in & 0x7f) << shift;
+        if (!(*in++ & 0x80))
+            return in;
+    }
+}
+
+} // namespace
+
+Rewind::Rewind(size_t capacity) :
+    _buffer(std::make_unique<uint8_t[]>(capacity)),
+    _capacity(capacity),
+    _current(std::make_unique<Chip8::State>()),
+    // Runs of one equal and one different byte take 3 bytes every 2.
+    _scratch(std::make_unique<uint8_t[]>(2 * sizeof(Chip8::State) + 16))
+{
+    // The padding of the states is never written, keep it equal.
+    memset(_current.get(), 0, sizeof(Chip8::State));
+}
+
+Rewind::~Rewind() {}
+
+void Rewind::push(const Chip8::State &state) {
+    if (!_has_current) {
+        memcpy(_current.get(), &state, sizeof(Chip8::State));
+        _has_current = true;
+        return;
+    }
+
+    size_t size = encode(reinterpret_cast<const uint8_t *>(_current.get()),
+        reinterpret_cast<const uint8_t *>(&state));
+    memcpy(_current.get(), &state, sizeof(Chip8::State));
+
+    uint32_t header = size;
+    size_t total = size + RECORD_OVERHEAD;
+    if (total > _capacity) {
+        // Cannot be stepped back, history restarts from this state.
+        _begin = _used = _frames = 0;
+        return;
+    }
+
+    // Drop the oldest records until this one fits.
+    while (_capacity - _used < total) {
+        uint32_t oldest;
+        read(_begin, reinterpret_cast<uint8_t *>(&oldest), 4);
+        _begin = (_begin + oldest + RECORD_OVERHEAD) % _capacity;
+        _used -= oldest + RECORD_OVERHEAD;
+        --_frames;
+    }
+
+    size_t end = (_begin + _used) % _capacity;
+    write(end, reinterpret_cast<const uint8_t *>(&header), 4);
+    write((end + 4) % _capacity, _scratch.get(), size);
+    write((end + 4 + size) % _capacity, reinterpret_cast<const uint8_t *>(&header), 4);
+    _used += total;
+    ++_frames;
+}
+
+bool Rewind::pop(Chip8::State &state) {
+    if (_frames == 0)
+        return false;
+
+    size_t end = _begin + _used;
+    uint32_t size;
+    read((end - 4) % _capacity, reinterpret_cast<uint8_t *>(&size), 4);
+    read((end - 4 - size) % _capacity, _scratch.get(), size);
+
+    decode(_scratch.get(), size, reinterpret_cast<uint8_t *>(_current.get()));
+    memcpy(&state, _current.get(), sizeof(Chip8::State));
+
+    _used -= size + RECORD_OVERHEAD;
+    --_frames;
+    return true;
+}
+
+void Rewind::clear() {
+    _begin = _used = _frames = 0;
+    _has_current = false;
+}
+
+size_t Rewind::get_frames() {
+    return _frames;
+}
+
+size_t Rewind::get_used() {
+    return _used;
+}
+
+size_t Rewind::encode(const uint8_t *previous, const uint8_t *current) {
+    const size_t length = sizeof(Chip8::State);
+    uint8_t *out = _scratch.get();
+    size_t i = 0;
+
+    while (i < length) {
+        // Equal bytes, 8 at a time while possible.
+        size_t begin = i;
+        for ( ; i + 8 <= length ; i += 8) {
+            uint64_t a, b;
+            memcpy(&a, previous + i, 8);
+            memcpy(&b, current + i, 8);
+            if (a != b)
+                break;
+        }
+        while (i < length && previous[i] == current[i])
+            ++i;
+        size_t equal = i - begin;
+
+        begin = i;
+        while (i < length && previous[i] != current[i])
+            ++i;
+
+        out = put_varint(out, equal);
+        out = put_varint(out, i - begin);
+        for (size_t j = begin ; j < i ; ++j)
+            *out++ = previous[j] ^ current[j];
+    }
+
+    return out - _scratch.get();
+}
+
+void Rewind::decode(const uint8_t *data, size_t size, uint8_t *state) {
+    const uint8_t *end = data + size;
+    size_t i = 0;
+
+    while (data < end) {
+        size_t equal, different;
+        data = get_varint(data, equal);
+        data = get_varint(data, different);
+        i += equal;
+        for (size_t j = 0 ; j < different ; ++j)
+            state[i++] ^= *data++;
+    }
+}
+
+void Rewind::write(size_t offset, const uint8_t *data, size_t size) {
+    size_t first = std::min(size, _capacity - offset);
+    memcpy(_buffer.get() + offset, data, first);
+    memcpy(_buffer.get(), data + first, size - first);
+}
+
+void Rewind::read(size_t offset, uint8_t *data, size_t size) {
+    size_t first = std::min(size, _capacity - offset);
+    memcpy(data, _buffer.get() + offset, first);
+    memcpy(data + first, _buffer.get(), size - first);
+}
+
+} // namespace tools::chip8
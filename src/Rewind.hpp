@@ -0,0 +1,77 @@
+#ifndef REWIND_HPP
+#define REWIND_HPP
+
+#include "Chip8.hpp"
+
+#include <memory>
+
+namespace tools::chip8 {
+
+/**
+ * History of states in a fixed amount of memory, for stepping a game backward.
+ *
+ * Each pushed state is stored as the run length encoded XOR of it and the previous one,
+ * a few dozen bytes for most frames. Records are XORed back into the newest state
+ * to go back in time, the oldest ones are dropped when the buffer is full.
+ */
+class Rewind {
+    public:
+
+    /**
+     * @param capacity Bytes of history at most.
+     */
+    Rewind(size_t capacity = 4 << 20);
+    ~Rewind();
+
+    /**
+     * @brief Record the state of a new frame.
+     */
+    void push(const Chip8::State &state);
+
+    /**
+     * @brief Step one frame back, state is set to the previous pushed one.
+     * The newest state is forgotten, pushing then continues from the previous one.
+     * @return false if there is no older state.
+     */
+    bool pop(Chip8::State &state);
+
+    void clear();
+
+    /**
+     * @return Number of frames that can be stepped back.
+     */
+    size_t get_frames();
+
+    /**
+     * @return Bytes of history in use.
+     */
+    size_t get_used();
+
+    private:
+
+    // Encode the difference of two states into _scratch, return its size.
+    size_t encode(const uint8_t *previous, const uint8_t *current);
+    void decode(const uint8_t *data, size_t size, uint8_t *state);
+
+    // Copy through the end of the ring.
+    void write(size_t offset, const uint8_t *data, size_t size);
+    void read(size_t offset, uint8_t *data, size_t size);
+
+    // Records : u32 size, encoded difference, u32 size again to walk them backward.
+    std::unique_ptr<uint8_t[]> _buffer;
+    size_t _capacity;
+    size_t _begin = 0;
+    size_t _used = 0;
+    size_t _frames = 0;
+
+    // Newest state, records are XORed into it.
+    std::unique_ptr<Chip8::State> _current;
+    bool _has_current = false;
+
+    // Worst case encoding of a record.
+    std::unique_ptr<uint8_t[]> _scratch;
+};
+
+} // namespace tools::chip8
+
+#endif // REWIND_HPP
@@ -30,6 +30,7 @@ void Scheduler::stop() {
 
 void Scheduler::loop() {
     while (is_running()) {
+        auto next_wake = std::chrono::steady_clock::time_point::max();
         for (auto &e : _tasks) {
             if (!is_running())
                 break;
@@ -40,9 +41,11 @@ void Scheduler::loop() {
                     SPDLOG_ERROR("Task '{}' returned false.", e.name);
                 e.next_run = now + e.delay_ns;
             }
+            next_wake = std::min(next_wake, e.next_run);
         }
-        if (!_high_precision) {
-            std::this_thread::sleep_for(std::chrono::microseconds(1));
+        if (!_high_precision && is_running() && !_tasks.empty()) {
+            // Nothing to do until the earliest task is due.
+            std::this_thread::sleep_until(next_wake);
         }
     }
 }
@@ -0,0 +1,124 @@
+#include "Chip8.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include "Endian.hpp"
+#include "files.hpp"
+
+#include <cstring>
+
+// Layout, every integer in little endian :
+//   "C8ST", u16 version, u16 reserved,
+//   memory, screen rows as u64, v, pc, i, stack as u16, sp, delay, sound, keys, rng as u64,
+//   instructions as u64 since version 2.
+#define STATE_MAGIC "C8ST"
+#define STATE_HEADER_SIZE 8
+// Version 1 had no instruction count.
+#define STATE_V1_SIZE (Chip8::State::SERIALIZED_SIZE - 8)
+
+namespace tools::chip8 {
+
+const size_t Chip8::State::SERIALIZED_SIZE = STATE_HEADER_SIZE
+    + MEMORY_SIZE + HEIGHT * 8 + REGISTERS_SIZE + 2 + 2 + STACK_SIZE * 2 + 3 + KEYS + 8 + 8;
+
+using utils::get_le;
+using utils::put_le;
+
+size_t Chip8::State::serialized_size(uint16_t version) {
+    switch (version) {
+        case 1:       return STATE_V1_SIZE;
+        case VERSION: return SERIALIZED_SIZE;
+        default:      return 0;
+    }
+}
+
+void Chip8::State::serialize(uint8_t *out) const {
+    memcpy(out, STATE_MAGIC, 4);
+    out = put_le<uint16_t>(out + 4, VERSION);
+    out = put_le<uint16_t>(out, 0);
+
+    memcpy(out, memory, MEMORY_SIZE);
+    out += MEMORY_SIZE;
+    for (int row = 0 ; row < HEIGHT ; ++row)
+        out = put_le(out, screen[row]);
+    memcpy(out, v, REGISTERS_SIZE);
+    out += REGISTERS_SIZE;
+    out = put_le(out, pc);
+    out = put_le(out, i);
+    for (int level = 0 ; level < STACK_SIZE ; ++level)
+        out = put_le(out, stack[level]);
+    *out++ = sp;
+    *out++ = delay_timer;
+    *out++ = sound_timer;
+    memcpy(out, keys, KEYS);
+    out += KEYS;
+    out = put_le(out, rng);
+    put_le(out, instructions);
+}
+
+std::vector<uint8_t> Chip8::State::serialize() const {
+    std::vector<uint8_t> data(SERIALIZED_SIZE);
+    serialize(data.data());
+    return data;
+}
+
+bool Chip8::State::deserialize(const uint8_t *data, size_t size) {
+    if (size < STATE_HEADER_SIZE || memcmp(data, STATE_MAGIC, 4) != 0) {
+        SPDLOG_ERROR("Not a state.");
+        return false;
+    }
+
+    uint16_t version;
+    const uint8_t *in = get_le(data + 4, version) + 2;
+    size_t expected = serialized_size(version);
+    if (expected == 0) {
+        SPDLOG_ERROR("State version {} is not supported, expected {} at most.", version, VERSION);
+        return false;
+    }
+
+    if (size != expected) {
+        SPDLOG_ERROR("State is {} bytes, expected {}.", size, expected);
+        return false;
+    }
+
+    memcpy(memory, in, MEMORY_SIZE);
+    in += MEMORY_SIZE;
+    for (int row = 0 ; row < HEIGHT ; ++row)
+        in = get_le(in, screen[row]);
+    memcpy(v, in, REGISTERS_SIZE);
+    in += REGISTERS_SIZE;
+    in = get_le(in, pc);
+    in = get_le(in, i);
+    for (int level = 0 ; level < STACK_SIZE ; ++level)
+        in = get_le(in, stack[level]);
+    sp = *in++;
+    delay_timer = *in++;
+    sound_timer = *in++;
+    memcpy(keys, in, KEYS);
+    in += KEYS;
+    in = get_le(in, rng);
+    if (version >= 2)
+        get_le(in, instructions);
+    else
+        instructions = 0;
+    return true;
+}
+
+bool Chip8::State::save(const std::string &path) const {
+    if (!utils::files::write_binary_file(serialize(), path)) {
+        SPDLOG_ERROR("Failed to write state '{}'.", path);
+        return false;
+    }
+    return true;
+}
+
+bool Chip8::State::load(const std::string &path) {
+    std::vector<uint8_t> data = utils::files::read_binary_file(path);
+    if (data.empty()) {
+        SPDLOG_ERROR("Failed to read state '{}'.", path);
+        return false;
+    }
+    return deserialize(data.data(), data.size());
+}
+
+} // namespace tools::chip8
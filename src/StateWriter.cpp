@@ -0,0 +1,85 @@
+#include "StateWriter.hpp"
+
+namespace tools::chip8 {
+
+StateWriter::StateWriter(size_t capacity) :
+    _slots(std::make_unique<Slot[]>(capacity > 0 ? capacity : 1)),
+    _capacity(capacity > 0 ? capacity : 1),
+    _thread(&StateWriter::worker, this)
+{}
+
+StateWriter::~StateWriter() {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+    _thread.join();
+}
+
+void StateWriter::write(const Chip8::State &state, const std::string &path) {
+    {
+        std::lock_guard lock(_mutex);
+
+        if (_pending == _capacity) {
+            _head = (_head + 1) % _capacity;
+            --_pending;
+            ++_dropped;
+        }
+
+        Slot &slot = _slots[(_head + _pending) % _capacity];
+        slot.state = state;
+        slot.path = path;
+        ++_pending;
+    }
+    _wake.notify_one();
+}
+
+void StateWriter::flush() {
+    std::unique_lock lock(_mutex);
+    _idle.wait(lock, [this] { return _pending == 0 && !_busy; });
+}
+
+uint64_t StateWriter::get_written() {
+    std::lock_guard lock(_mutex);
+    return _written;
+}
+
+uint64_t StateWriter::get_dropped() {
+    std::lock_guard lock(_mutex);
+    return _dropped;
+}
+
+uint64_t StateWriter::get_failed() {
+    std::lock_guard lock(_mutex);
+    return _failed;
+}
+
+void StateWriter::worker() {
+    std::unique_lock lock(_mutex);
+
+    while (true) {
+        _wake.wait(lock, [this] { return _pending > 0 || _stop; });
+        if (_pending == 0)
+            break;
+
+        // Take the state out of the ring so that write() is free to reuse the slot.
+        std::swap(_current, _slots[_head]);
+        _head = (_head + 1) % _capacity;
+        --_pending;
+        _busy = true;
+
+        lock.unlock();
+        bool ok = _current.state.save(_current.path);
+        lock.lock();
+
+        _busy = false;
+        if (ok)
+            ++_written;
+        else
+            ++_failed;
+        _idle.notify_all();
+    }
+}
+
+} // namespace tools::chip8
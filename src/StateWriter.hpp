@@ -0,0 +1,74 @@
+#ifndef STATEWRITER_HPP
+#define STATEWRITER_HPP
+
+#include "Chip8.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace tools::chip8 {
+
+/**
+ * Writes states to disk from its own thread so that the emulation never waits for it.
+ */
+class StateWriter {
+    public:
+
+    /**
+     * @param capacity Number of states waiting to be written at most.
+     */
+    StateWriter(size_t capacity = 8);
+
+    // Writes the pending states, then stops.
+    ~StateWriter();
+
+    /**
+     * @brief Queue a copy of state to be written at path.
+     * Never waits for the disk : when capacity states are pending, the oldest one is dropped.
+     */
+    void write(const Chip8::State &state, const std::string &path);
+
+    /**
+     * @brief Wait until every queued state is written.
+     */
+    void flush();
+
+    uint64_t get_written();
+    uint64_t get_dropped();
+    uint64_t get_failed();
+
+    private:
+
+    struct Slot {
+        Chip8::State state;
+        std::string path;
+    };
+
+    void worker();
+
+    // Ring of pending states, the oldest one at _head.
+    std::unique_ptr<Slot[]> _slots;
+    size_t _capacity;
+    size_t _head = 0;
+    size_t _pending = 0;
+    // The state being written, out of the ring.
+    Slot _current;
+    bool _busy = false;
+    bool _stop = false;
+
+    uint64_t _written = 0;
+    uint64_t _dropped = 0;
+    uint64_t _failed = 0;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    std::thread _thread;
+};
+
+} // namespace tools::chip8
+
+#endif // STATEWRITER_HPP
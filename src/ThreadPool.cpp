@@ -0,0 +1,157 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace tools::utils {
+
+static uint64_t pack(uint32_t begin, uint32_t end) {
+    return begin | (uint64_t)end << 32;
+}
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    _size = threads;
+    _queues = std::make_unique<Queue[]>(_size);
+    for (unsigned i = 0 ; i < _size ; ++i)
+        _queues[i].range = 0;
+
+    // The calling thread works too.
+    for (unsigned i = 0 ; i + 1 < _size ; ++i)
+        _threads.emplace_back(&ThreadPool::worker, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+
+    for (auto &thread : _threads)
+        thread.join();
+}
+
+unsigned ThreadPool::size() {
+    return _size;
+}
+
+void ThreadPool::run(size_t count, size_t grain, Body body, void *context) {
+    if (count == 0)
+        return;
+
+    if (grain == 0)
+        grain = 1;
+
+    // Chunk indices must fit the packed ranges.
+    if ((count + grain - 1) / grain > UINT32_MAX)
+        grain = (count + UINT32_MAX - 1) / UINT32_MAX;
+
+    uint32_t chunks = (count + grain - 1) / grain;
+
+    // Contiguous shares keep neighbouring indices on the same thread.
+    for (unsigned i = 0 ; i < _size ; ++i) {
+        uint32_t begin = (uint64_t)chunks * i / _size;
+        uint32_t end = (uint64_t)chunks * (i + 1) / _size;
+        _queues[i].range.store(pack(begin, end), std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard lock(_mutex);
+        _body = body;
+        _context = context;
+        _count = count;
+        _grain = grain;
+        _busy = _threads.size();
+        ++_generation;
+    }
+    _wake.notify_all();
+
+    work(_size - 1);
+
+    // Workers may still be running their last chunk.
+    std::unique_lock lock(_mutex);
+    _done.wait(lock, [this] { return _busy == 0; });
+}
+
+void ThreadPool::worker(unsigned index) {
+    uint64_t generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            _wake.wait(lock, [&] { return _stop || _generation != generation; });
+            if (_stop)
+                return;
+            generation = _generation;
+        }
+
+        work(index);
+
+        std::lock_guard lock(_mutex);
+        if (--_busy == 0)
+            _done.notify_one();
+    }
+}
+
+void ThreadPool::work(unsigned index) {
+    uint32_t chunk;
+    while (true) {
+        while (pop(index, chunk))
+            execute(chunk);
+
+        if (!steal(index))
+            return;
+    }
+}
+
+bool ThreadPool::pop(unsigned index, uint32_t &chunk) {
+    std::atomic<uint64_t> &range = _queues[index].range;
+    uint64_t current = range.load(std::memory_order_acquire);
+
+    while (true) {
+        uint32_t begin = current;
+        uint32_t end = current >> 32;
+        if (begin >= end)
+            return false;
+
+        if (range.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel)) {
+            chunk = begin;
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::steal(unsigned index) {
+    for (unsigned i = 1 ; i < _size ; ++i) {
+        std::atomic<uint64_t> &range = _queues[(index + i) % _size].range;
+        uint64_t current = range.load(std::memory_order_acquire);
+
+        while (true) {
+            uint32_t begin = current;
+            uint32_t end = current >> 32;
+            if (begin >= end)
+                break;
+
+            // Take the upper half, the owner keeps working from the bottom.
+            uint32_t middle = end - (end - begin + 1) / 2;
+            if (range.compare_exchange_weak(current, pack(begin, middle), std::memory_order_acq_rel)) {
+                // Nobody steals from an empty queue, a plain store is enough.
+                _queues[index].range.store(pack(middle, end), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(uint32_t chunk) {
+    size_t begin = (size_t)chunk * _grain;
+    size_t end = std::min(begin + _grain, _count);
+    _body(_context, begin, end);
+}
+
+} // namespace tools::utils
@@ -0,0 +1,83 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tools::utils {
+
+class ThreadPool {
+    public:
+
+    /**
+     * @brief Start the worker threads.
+     * @param threads Number of threads working on a parallel_for(), the calling
+     * thread included. 0 => one per hardware thread.
+     */
+    ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    unsigned size();
+
+    /**
+     * @brief Call fn(begin, end) on chunks of [0, count) from every thread, then return.
+     * Each thread starts on its own contiguous share of the chunks and steals
+     * half of the remaining chunks of another thread when it runs out.
+     * Does not allocate. fn must not throw.
+     * @param grain Number of indices per chunk.
+     */
+    template <typename Function>
+    void parallel_for(size_t count, size_t grain, Function &&fn) {
+        using Decayed = std::remove_reference_t<Function>;
+        run(count, grain, [](void *context, size_t begin, size_t end) {
+            (*static_cast<Decayed *>(context))(begin, end);
+        }, &fn);
+    }
+
+    private:
+
+    using Body = void (*)(void *context, size_t begin, size_t end);
+
+    // Chunks [begin, end) left to a thread, packed as begin | end << 32
+    // so that the owner and the thieves update both bounds at once.
+    struct alignas(64) Queue {
+        std::atomic<uint64_t> range;
+    };
+
+    void run(size_t count, size_t grain, Body body, void *context);
+    void worker(unsigned index);
+
+    // Execute chunks until none is left anywhere.
+    void work(unsigned index);
+    bool pop(unsigned index, uint32_t &chunk);
+    bool steal(unsigned index);
+    void execute(uint32_t chunk);
+
+    std::vector<std::thread> _threads;
+
+    // One per thread, the calling thread being the last.
+    std::unique_ptr<Queue[]> _queues;
+    unsigned _size;
+
+    // Current job.
+    Body _body = nullptr;
+    void *_context = nullptr;
+    size_t _count = 0;
+    size_t _grain = 1;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    uint64_t _generation = 0;
+    unsigned _busy = 0;
+    bool _stop = false;
+};
+
+} // namespace tools::utils
+
+#endif // THREADPOOL_HPP
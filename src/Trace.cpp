@@ -0,0 +1,112 @@
+#include "Trace.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include "files.hpp"
+
+#include <bit>
+#include <cstring>
+
+// File layout : magic, version, record count, then the records.
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 12
+#define TRACE_RECORD_SIZE 8
+
+namespace tools::chip8 {
+
+namespace {
+
+void put16(std::vector<uint8_t> &out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+void put32(std::vector<uint8_t> &out, uint32_t value) {
+    put16(out, value & 0xffff);
+    put16(out, value >> 16);
+}
+
+uint16_t get16(const uint8_t *in) {
+    return in[0] | (in[1] << 8);
+}
+
+uint32_t get32(const uint8_t *in) {
+    return get16(in) | (get16(in + 2) << 16);
+}
+
+} // namespace
+
+Trace::Trace(size_t capacity) {
+    capacity = std::bit_ceil(std::max<size_t>(capacity, 1));
+    _records = std::make_unique<TraceRecord[]>(capacity);
+    _mask = capacity - 1;
+}
+
+Trace::~Trace() {}
+
+void Trace::clear() {
+    _next = 0;
+}
+
+size_t Trace::size() const {
+    return std::min<uint64_t>(_next, _mask + 1);
+}
+
+bool Trace::dump(const std::string &path) const {
+    size_t count = size();
+
+    std::vector<uint8_t> data(TRACE_MAGIC, TRACE_MAGIC + 4);
+    put16(data, TRACE_VERSION);
+    put16(data, 0);
+    put32(data, count);
+    data.reserve(TRACE_HEADER_SIZE + count * TRACE_RECORD_SIZE);
+
+    for (uint64_t n = _next - count ; n < _next ; ++n) {
+        const TraceRecord &record = _records[n & _mask];
+        put16(data, record.pc);
+        put16(data, record.opcode);
+        put16(data, record.i);
+        data.push_back(record.x);
+        data.push_back(record.vx);
+    }
+
+    return tools::utils::files::write_binary_file(data, path);
+}
+
+std::vector<TraceRecord> Trace::load(const std::string &path) {
+    std::vector<TraceRecord> records;
+
+    auto data = tools::utils::files::read_binary_file(path);
+    if (data.size() < TRACE_HEADER_SIZE || memcmp(data.data(), TRACE_MAGIC, 4) != 0) {
+        SPDLOG_ERROR("'{}' is not a trace file.", path);
+        return records;
+    }
+
+    uint16_t version = get16(&data[4]);
+    if (version != TRACE_VERSION) {
+        SPDLOG_ERROR("Unsupported trace version {} in '{}'.", version, path);
+        return records;
+    }
+
+    uint32_t count = get32(&data[8]);
+    if (data.size() < TRACE_HEADER_SIZE + (size_t)count * TRACE_RECORD_SIZE) {
+        SPDLOG_ERROR("Trace '{}' is truncated.", path);
+        return records;
+    }
+
+    records.resize(count);
+    const uint8_t *in = &data[TRACE_HEADER_SIZE];
+    for (auto &record : records) {
+        record.pc = get16(in);
+        record.opcode = get16(in + 2);
+        record.i = get16(in + 4);
+        record.x = in[6];
+        record.vx = in[7];
+        in += TRACE_RECORD_SIZE;
+    }
+
+    return records;
+}
+
+} // namespace tools::chip8
@@ -0,0 +1,69 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tools::chip8 {
+
+// One executed instruction.
+struct TraceRecord {
+    uint16_t pc;        // Address of the instruction.
+    uint16_t opcode;
+    uint16_t i;         // I after execution.
+    uint8_t x;          // Register selected by the 0x0f00 bits of the opcode...
+    uint8_t vx;         // ...and its value after execution.
+};
+
+/**
+ * Ring buffer of the last executed instructions.
+ * Records are fixed size and written without formatting,
+ * dump() saves them and load() reads them back for decoding.
+ */
+class Trace {
+    public:
+
+    /**
+     * @param capacity Number of records kept, rounded up to a power of two.
+     */
+    Trace(size_t capacity);
+    ~Trace();
+
+    void record(const TraceRecord &record) {
+        _records[_next & _mask] = record;
+        ++_next;
+    }
+
+    void clear();
+
+    // Number of records held, at most the capacity.
+    size_t size() const;
+
+    /**
+     * @brief Write the records, oldest first, to a file.
+     * Fields are stored little endian whatever the host.
+     * @return true => ok ; false => error.
+     */
+    bool dump(const std::string &path) const;
+
+    /**
+     * @brief Read records written by dump().
+     * @return The records, empty on error.
+     */
+    static std::vector<TraceRecord> load(const std::string &path);
+
+    private:
+
+    std::unique_ptr<TraceRecord[]> _records;
+    size_t _mask;
+
+    // Total number of records ever written.
+    uint64_t _next = 0;
+};
+
+} // namespace tools::chip8
+
+#endif // TRACE_HPP
@@ -0,0 +1,192 @@
+#include "VecEnv.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+// Environments per work item, same as BatchEngine::step().
+#define GRAIN 16
+
+namespace tools::chip8 {
+
+VecEnv::VecEnv(size_t count, unsigned threads) : _engine(count, threads) {
+    _episodes = std::make_unique<Episode[]>(count);
+}
+
+VecEnv::~VecEnv() {}
+
+size_t VecEnv::size() {
+    return _engine.size();
+}
+
+Chip8 &VecEnv::instance(size_t index) {
+    return _engine.instance(index);
+}
+
+bool VecEnv::load_rom(const std::vector<uint8_t> &rom) {
+    return _engine.load_rom(rom);
+}
+
+void VecEnv::set_backend(Chip8::Backend backend) {
+    _engine.set_backend(backend);
+}
+
+bool VecEnv::set_quirks_profile(const std::string &name) {
+    return _engine.set_quirks_profile(name);
+}
+
+void VecEnv::set_cpu_freq(uint32_t cpu_freq) {
+    _engine.set_cpu_freq(cpu_freq);
+}
+
+void VecEnv::set_frame_skip(uint32_t frames) {
+    if (frames == 0) {
+        SPDLOG_ERROR("Frame skip must be at least 1.");
+        return;
+    }
+    _frame_skip = frames;
+}
+
+void VecEnv::set_max_frames(uint64_t frames) {
+    _max_frames = frames;
+}
+
+bool VecEnv::set_observation(Observation observation, int downsample) {
+    if (downsample != 1 && downsample != 2 && downsample != 4 && downsample != 8) {
+        SPDLOG_ERROR("Unsupported downsampling {}, must be 1, 2, 4 or 8.", downsample);
+        return false;
+    }
+
+    _observation = observation;
+    _downsample = downsample;
+    return true;
+}
+
+size_t VecEnv::observation_size() {
+    if (_observation == Observation::bitboard)
+        return HEIGHT * sizeof(uint64_t);
+    return (WIDTH / _downsample) * (HEIGHT / _downsample);
+}
+
+void VecEnv::add_reward(const RewardReader &reader) {
+    if (reader.size < 1 || reader.size > 4) {
+        SPDLOG_ERROR("Reward values are 1 to 4 bytes, got {}.", reader.size);
+        return;
+    }
+    _rewards.push_back(reader);
+}
+
+void VecEnv::clear_rewards() {
+    _rewards.clear();
+}
+
+void VecEnv::reset(const uint64_t *seeds, uint8_t *observations) {
+    size_t stride = observation_size();
+    _engine.parallel_for(GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin ; i < end ; ++i) {
+            start(i, seeds[i]);
+            observe(i, observations + i * stride);
+        }
+    });
+}
+
+void VecEnv::reset(size_t index, uint64_t seed, uint8_t *observation) {
+    start(index, seed);
+    observe(index, observation);
+}
+
+void VecEnv::step(const uint16_t *actions, uint8_t *observations, float *rewards, uint8_t *dones) {
+    size_t stride = observation_size();
+    _engine.parallel_for(GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin ; i < end ; ++i) {
+            BatchEngine::Slot &slot = _engine.slot(i);
+
+            slot.cpu.set_keys(actions[i]);
+            _engine.step_instance(i, _frame_skip);
+            rewards[i] = collect(i);
+
+            bool done = slot.halted || (_max_frames > 0 && slot.frames >= _max_frames);
+            dones[i] = done;
+            if (done)
+                start(i, hash_term(_episodes[i].seed, slot.frames));
+
+            observe(i, observations + i * stride);
+        }
+    });
+}
+
+void VecEnv::start(size_t index, uint64_t seed) {
+    Episode &episode = _episodes[index];
+    episode.seed = seed;
+
+    _engine.reset_instance(index);
+    Chip8 &cpu = _engine.instance(index);
+    cpu.seed(seed);
+
+    // Only reallocated when readers were added or removed.
+    if (episode.readers != _rewards.size()) {
+        episode.readers = _rewards.size();
+        episode.values = std::make_unique<uint32_t[]>(episode.readers);
+    }
+
+    for (size_t r = 0 ; r < episode.readers ; ++r)
+        episode.values[r] = read(cpu, _rewards[r]);
+}
+
+void VecEnv::observe(size_t index, uint8_t *observation) {
+    const uint64_t *rows = _engine.instance(index).get_screen_buffer();
+
+    if (_observation == Observation::bitboard) {
+        memcpy(observation, rows, HEIGHT * sizeof(uint64_t));
+        return;
+    }
+
+    // Count the pixels on in each block, one row of blocks at a time.
+    int block = _downsample;
+    int pixels = block * block;
+    uint64_t mask = (1ull << block) - 1;
+    for (int y = 0 ; y < HEIGHT ; y += block) {
+        for (int x = 0 ; x < WIDTH ; x += block) {
+            int shift = WIDTH - block - x;
+            int on = 0;
+            for (int row = y ; row < y + block ; ++row)
+                on += std::popcount((rows[row] >> shift) & mask);
+            *observation++ = on * 255 / pixels;
+        }
+    }
+}
+
+uint32_t VecEnv::read(Chip8 &cpu, const RewardReader &reader) {
+    uint32_t value = 0;
+    for (uint8_t byte = 0 ; byte < reader.size ; ++byte)
+        value = (value << 8) | cpu.get_memory(reader.addr + byte);
+    return value;
+}
+
+float VecEnv::collect(size_t index) {
+    Episode &episode = _episodes[index];
+    Chip8 &cpu = _engine.instance(index);
+
+    // Readers changed since the episode started are ignored until the next one.
+    size_t readers = std::min(episode.readers, _rewards.size());
+
+    float reward = 0.0f;
+    for (size_t r = 0 ; r < readers ; ++r) {
+        const RewardReader &reader = _rewards[r];
+        uint32_t value = read(cpu, reader);
+        if (reader.delta) {
+            reward += reader.scale * (static_cast<int64_t>(value) - episode.values[r]);
+            episode.values[r] = value;
+        }
+        else {
+            reward += reader.scale * value;
+        }
+    }
+    return reward;
+}
+
+} // namespace tools::chip8
@@ -0,0 +1,149 @@
+#ifndef VECENV_HPP
+#define VECENV_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BatchEngine.hpp"
+
+namespace tools::chip8 {
+
+/**
+ * @brief Reinforcement learning environments over the machines of a BatchEngine.
+ * Every call steps all the environments on the pool and writes the results
+ * to buffers owned by the caller, one entry per environment.
+ * Nothing is allocated while stepping.
+ */
+class VecEnv {
+    public:
+
+    enum class Observation {
+        // The HEIGHT rows of get_screen_buffer(), in native byte order.
+        bitboard,
+        // One byte per block of downsample x downsample pixels, row after row,
+        // from 0 (all pixels off) to 255 (all pixels on).
+        frame
+    };
+
+    // Value read from memory after every step.
+    struct RewardReader {
+        uint16_t addr;
+        // Number of bytes of the value, big endian, 1 to 4.
+        uint8_t size = 1;
+        float scale = 1.0f;
+        // true => the reward is the change of the value during the step.
+        // false => the reward is the value itself.
+        bool delta = true;
+    };
+
+    /**
+     * @param threads See ThreadPool.
+     */
+    VecEnv(size_t count, unsigned threads = 0);
+    ~VecEnv();
+
+    size_t size();
+
+    /**
+     * @brief Machine of an environment, to configure it or inspect its state.
+     */
+    Chip8 &instance(size_t index);
+
+    /**
+     * @brief Load the rom played by every environment.
+     * Environments start when reset() is called.
+     */
+    bool load_rom(const std::vector<uint8_t> &rom);
+
+    void set_backend(Chip8::Backend backend);
+    bool set_quirks_profile(const std::string &name);
+
+    /**
+     * @param cpu_freq Instructions per second of emulated time, at least 60.
+     */
+    void set_cpu_freq(uint32_t cpu_freq);
+
+    /**
+     * @brief Number of frames of 1/60 s run by step(), the action being held for all of them.
+     */
+    void set_frame_skip(uint32_t frames);
+
+    /**
+     * @brief End episodes after a number of frames, 0 => only when the rom halts.
+     */
+    void set_max_frames(uint64_t frames);
+
+    /**
+     * @param downsample Side of the blocks of pixels of Observation::frame,
+     * 1, 2, 4 or 8.
+     * @return false if downsample is not supported.
+     */
+    bool set_observation(Observation observation, int downsample = 1);
+
+    /**
+     * @return Bytes written per environment in the observations buffer.
+     */
+    size_t observation_size();
+
+    /**
+     * @brief The reward of a step is the sum of the rewards of every reader.
+     * Readers take effect when an environment is reset.
+     */
+    void add_reward(const RewardReader &reader);
+    void clear_rewards();
+
+    /**
+     * @brief Start a new episode in every environment.
+     * @param seeds One seed per environment, see Chip8::seed().
+     * @param observations size() * observation_size() bytes.
+     */
+    void reset(const uint64_t *seeds, uint8_t *observations);
+
+    /**
+     * @brief Start a new episode in one environment.
+     * @param observation observation_size() bytes.
+     */
+    void reset(size_t index, uint64_t seed, uint8_t *observation);
+
+    /**
+     * @brief Hold the keys of each action for the frame skip, then observe.
+     * An environment whose episode ended is reset with a seed derived from its
+     * previous one, and its observation is the first one of the new episode.
+     * @param actions One mask of pressed keys per environment, bit k being key k.
+     * @param observations size() * observation_size() bytes.
+     * @param rewards One reward per environment.
+     * @param dones One flag per environment, set when the episode ended.
+     */
+    void step(const uint16_t *actions, uint8_t *observations, float *rewards, uint8_t *dones);
+
+    private:
+
+    // Per environment state besides its machine.
+    struct Episode {
+        uint64_t seed;
+        // Readers values at the end of the previous step, see read().
+        std::unique_ptr<uint32_t[]> values;
+        size_t readers = 0;
+    };
+
+    void start(size_t index, uint64_t seed);
+    void observe(size_t index, uint8_t *observation);
+    uint32_t read(Chip8 &cpu, const RewardReader &reader);
+
+    // Sum of the rewards since the previous call.
+    float collect(size_t index);
+
+    BatchEngine _engine;
+    std::unique_ptr<Episode[]> _episodes;
+
+    std::vector<RewardReader> _rewards;
+    uint32_t _frame_skip = 1;
+    uint64_t _max_frames = 0;
+    Observation _observation = Observation::bitboard;
+    int _downsample = 1;
+};
+
+} // namespace tools::chip8
+
+#endif // VECENV_HPP
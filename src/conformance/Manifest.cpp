@@ -0,0 +1,154 @@
+#include "conformance/Manifest.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <fstream>
+#include <sstream>
+
+// Checkpoints of roms added without a case.
+#define DEFAULT_CHECKPOINTS { 60, 300, 600 }
+
+namespace tools::chip8::conformance {
+
+// Read a decimal or 0x prefixed number.
+template <typename T>
+static bool read_number(std::istringstream &words, T &value) {
+    std::string word;
+    if (!(words >> word))
+        return false;
+
+    try {
+        size_t end;
+        value = std::stoull(word, &end, 0);
+        return end == word.size();
+    }
+    catch (const std::exception &) {
+        return false;
+    }
+}
+
+bool Manifest::load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        SPDLOG_ERROR("Failed to open manifest '{}'.", path);
+        return false;
+    }
+
+    cases.clear();
+
+    std::string line;
+    for (int number = 1 ; std::getline(file, line) ; ++number) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.resize(comment);
+
+        std::istringstream words(line);
+        std::string directive;
+        if (!(words >> directive))
+            continue;
+
+        if (directive == "rom") {
+            cases.emplace_back();
+            if (!(words >> cases.back().rom)) {
+                SPDLOG_ERROR("{}:{} : rom without a path.", path, number);
+                return false;
+            }
+            continue;
+        }
+
+        if (cases.empty()) {
+            SPDLOG_ERROR("{}:{} : '{}' before the first rom.", path, number, directive);
+            return false;
+        }
+
+        RomCase &rom = cases.back();
+        bool ok;
+
+        if (directive == "quirks")
+            ok = static_cast<bool>(words >> rom.quirks);
+        else if (directive == "cpu-freq")
+            ok = read_number(words, rom.cpu_freq) && rom.cpu_freq >= 60;
+        else if (directive == "seed")
+            ok = read_number(words, rom.seed);
+        else if (directive == "budget-ms")
+            ok = read_number(words, rom.budget_ms);
+        else if (directive == "input") {
+            Input input;
+            ok = read_number(words, input.frame) && read_number(words, input.keys);
+            rom.inputs.push_back(input);
+        }
+        else if (directive == "check") {
+            Checkpoint checkpoint;
+            ok = read_number(words, checkpoint.frame);
+
+            std::string hash;
+            if (ok && words >> hash) {
+                try {
+                    checkpoint.hash = std::stoull(hash, nullptr, 16);
+                }
+                catch (const std::exception &) {
+                    ok = false;
+                }
+            }
+            rom.checkpoints.push_back(checkpoint);
+        }
+        else
+            ok = false;
+
+        if (!ok) {
+            SPDLOG_ERROR("{}:{} : invalid line '{}'.", path, number, line);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Manifest::save(const std::string &path) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    RomCase defaults;
+    for (const RomCase &rom : cases) {
+        file << "rom " << rom.rom << "\n";
+        if (!rom.quirks.empty())
+            file << "quirks " << rom.quirks << "\n";
+        if (rom.cpu_freq != defaults.cpu_freq)
+            file << "cpu-freq " << rom.cpu_freq << "\n";
+        if (rom.seed != defaults.seed)
+            file << "seed " << rom.seed << "\n";
+        if (rom.budget_ms != defaults.budget_ms)
+            file << "budget-ms " << rom.budget_ms << "\n";
+
+        for (const Input &input : rom.inputs)
+            file << fmt::format("input {} 0x{:04x}\n", input.frame, input.keys);
+
+        for (const Checkpoint &checkpoint : rom.checkpoints) {
+            if (checkpoint.hash)
+                file << fmt::format("check {} {:016x}\n", checkpoint.frame, *checkpoint.hash);
+            else
+                file << fmt::format("check {}\n", checkpoint.frame);
+        }
+        file << "\n";
+    }
+
+    return static_cast<bool>(file);
+}
+
+void Manifest::add(const std::string &rom) {
+    RomCase &added = cases.emplace_back();
+    added.rom = rom;
+    for (uint64_t frame : DEFAULT_CHECKPOINTS)
+        added.checkpoints.push_back({ frame, std::nullopt });
+}
+
+const RomCase *Manifest::find(const std::string &rom) {
+    for (const RomCase &existing : cases) {
+        if (existing.rom == rom)
+            return &existing;
+    }
+    return nullptr;
+}
+
+} // namespace tools::chip8::conformance
@@ -0,0 +1,73 @@
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace tools::chip8::conformance {
+
+// Screen expected after a number of frames.
+struct Checkpoint {
+    uint64_t frame;
+    // Chip8::frame_hash(), missing until recorded with --update.
+    std::optional<uint64_t> hash;
+};
+
+// Keys held from a frame on, until the next input.
+struct Input {
+    uint64_t frame;
+    uint16_t keys;
+};
+
+struct RomCase {
+    // Relative to the manifest directory.
+    std::string rom;
+    std::string quirks;
+    uint32_t cpu_freq = 1000;
+    uint64_t seed = 0;
+    // Wall clock time allowed to the whole run, in milliseconds.
+    // Only checked with chip8-conformance --budgets.
+    uint32_t budget_ms = 1000;
+    std::vector<Input> inputs;
+    std::vector<Checkpoint> checkpoints;
+};
+
+/**
+ * Text file listing the roms to run and their golden frame hashes.
+ * One directive per line, '#' starts a comment:
+ *
+ *   rom PATH           starts a case, the directives below apply to it
+ *   quirks NAME        quirks profile
+ *   cpu-freq N         instructions per second of emulated time
+ *   seed N             seed of the random generator
+ *   budget-ms N        time allowed to the run, see --budgets
+ *   input FRAME KEYS   hold a key mask from FRAME on
+ *   check FRAME [HASH] expected frame hash after FRAME frames
+ */
+class Manifest {
+    public:
+
+    /**
+     * @return false if the file cannot be read or has an invalid line.
+     */
+    bool load(const std::string &path);
+    bool save(const std::string &path);
+
+    /**
+     * @brief Add a case with default checkpoints for a rom not in the manifest yet.
+     */
+    void add(const std::string &rom);
+
+    /**
+     * @return The case of a rom, nullptr if it is not in the manifest.
+     */
+    const RomCase *find(const std::string &rom);
+
+    std::vector<RomCase> cases;
+};
+
+} // namespace tools::chip8::conformance
+
+#endif // MANIFEST_HPP
@@ -0,0 +1,281 @@
+#include "spdlog/spdlog.h"
+
+#include "Chip8.hpp"
+#include "conformance/Manifest.hpp"
+#include "Stopwatch.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+
+namespace {
+
+using tools::chip8::Chip8;
+using namespace tools::chip8::conformance;
+
+// One rom run with one backend.
+struct Job {
+    const RomCase *rom;
+    Chip8::Backend backend;
+    bool loaded = false;
+    // One per checkpoint of the case, in the same order.
+    std::vector<uint64_t> hashes;
+    double ms = 0;
+};
+
+void usage() {
+    SPDLOG_INFO("Usage : chip8-conformance [rom directory] [options]");
+    SPDLOG_INFO("  --manifest PATH     golden hashes, see Manifest (default [rom directory]/manifest.txt)");
+    SPDLOG_INFO("  --backend NAME      interpreter, predecoded, jit or all (default all)");
+    SPDLOG_INFO("  --threads N         threads, calling thread included (default all)");
+    SPDLOG_INFO("  --budgets           fail runs slower than their budget-ms, runs one at a time");
+    SPDLOG_INFO("  --update            record the hashes of the interpreter as golden ones,");
+    SPDLOG_INFO("                      adding the roms of the directory missing from the manifest");
+}
+
+const char *backend_name(Chip8::Backend backend) {
+    switch (backend) {
+        case Chip8::Backend::interpreter:   return "interpreter";
+        case Chip8::Backend::predecoded:    return "predecoded";
+        case Chip8::Backend::jit:           return "jit";
+    }
+    return "";
+}
+
+bool parse_backends(const std::string &name, std::vector<Chip8::Backend> &backends) {
+    using Backend = Chip8::Backend;
+
+    if (name == "all")
+        backends = { Backend::interpreter, Backend::predecoded, Backend::jit };
+    else if (name == "interpreter")
+        backends = { Backend::interpreter };
+    else if (name == "predecoded")
+        backends = { Backend::predecoded };
+    else if (name == "jit")
+        backends = { Backend::jit };
+    else {
+        SPDLOG_ERROR("Unknown backend '{}'.", name);
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> list_roms(const std::filesystem::path &directory) {
+    std::vector<std::string> roms;
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+        std::string extension = entry.path().extension().string();
+        if (entry.is_regular_file() && (extension == ".ch8" || extension == ".c8"))
+            roms.push_back(entry.path().filename().string());
+    }
+    std::sort(roms.begin(), roms.end());
+    return roms;
+}
+
+void run(const std::filesystem::path &directory, Job &job) {
+    using StopReason = Chip8::StopReason;
+
+    const RomCase &rom = *job.rom;
+    tools::utils::Stopwatch stopwatch;
+
+    Chip8 cpu;
+    if (!cpu.load_rom((directory / rom.rom).string()))
+        return;
+    if (!rom.quirks.empty() && !cpu.set_quirks_profile(rom.quirks))
+        return;
+    cpu.seed(rom.seed);
+    cpu.set_backend(job.backend);
+    job.loaded = true;
+
+    job.hashes.assign(rom.checkpoints.size(), 0);
+    uint64_t frames = 0;
+    for (const Checkpoint &checkpoint : rom.checkpoints)
+        frames = std::max(frames, checkpoint.frame);
+
+    size_t input = 0;
+    uint32_t remainder = 0;
+
+    for (uint64_t frame = 0 ; ; ++frame) {
+        for (size_t c = 0 ; c < rom.checkpoints.size() ; ++c) {
+            if (rom.checkpoints[c].frame == frame)
+                job.hashes[c] = cpu.frame_hash();
+        }
+
+        if (frame == frames)
+            break;
+
+        // Inputs are sorted by frame in any sensible manifest.
+        for ( ; input < rom.inputs.size() && rom.inputs[input].frame <= frame ; ++input)
+            cpu.set_keys(rom.inputs[input].keys);
+
+        // Spread cpu_freq instructions over 60 frames without drifting.
+        remainder += rom.cpu_freq;
+        uint32_t budget = remainder / 60;
+        remainder %= 60;
+
+        while (budget > 0) {
+            Chip8::RunResult result = cpu.run(budget);
+            budget -= result.executed;
+
+            // Nothing happens until the next frame.
+            if (result.reason == StopReason::halt_loop
+                || result.reason == StopReason::idle
+                || result.reason == StopReason::waiting_for_key)
+                break;
+        }
+
+        cpu.decrease_timers();
+    }
+
+    job.ms = stopwatch.get_duration() / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage();
+        return 0;
+    }
+
+    std::filesystem::path directory = argv[1];
+    std::string manifest_path = (directory / "manifest.txt").string();
+    std::vector<Chip8::Backend> backends;
+    parse_backends("all", backends);
+    unsigned threads = 0;
+    bool update = false;
+    bool budgets = false;
+
+    for (int i = 2 ; i < argc ; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--manifest" && has_value)
+            manifest_path = argv[++i];
+        else if (arg == "--backend" && has_value) {
+            if (!parse_backends(argv[++i], backends))
+                return 1;
+        }
+        else if (arg == "--threads" && has_value)
+            threads = std::stoul(argv[++i]);
+        else if (arg == "--update")
+            update = true;
+        else if (arg == "--budgets")
+            budgets = true;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!std::filesystem::is_directory(directory)) {
+        SPDLOG_ERROR("'{}' is not a directory.", directory.string());
+        return 1;
+    }
+
+    Manifest manifest;
+    if (std::filesystem::exists(manifest_path)) {
+        if (!manifest.load(manifest_path))
+            return 1;
+    }
+    else if (!update) {
+        SPDLOG_ERROR("No manifest at '{}', create it with --update.", manifest_path);
+        return 1;
+    }
+
+    for (const std::string &rom : list_roms(directory)) {
+        if (manifest.find(rom))
+            continue;
+        if (update)
+            manifest.add(rom);
+        else
+            SPDLOG_WARN("{} is not in the manifest, skipped.", rom);
+    }
+
+    // The interpreter is the reference for updates.
+    if (update && backends.front() != Chip8::Backend::interpreter)
+        backends.insert(backends.begin(), Chip8::Backend::interpreter);
+
+    std::vector<Job> jobs;
+    for (const RomCase &rom : manifest.cases) {
+        for (Chip8::Backend backend : backends)
+            jobs.push_back({ &rom, backend, false, {}, 0 });
+    }
+
+    // Runs sharing the cores would be timed against each other.
+    if (budgets)
+        threads = 1;
+
+    tools::utils::ThreadPool pool(threads);
+    tools::utils::Stopwatch stopwatch;
+    pool.parallel_for(jobs.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t j = begin ; j < end ; ++j)
+            run(directory, jobs[j]);
+    });
+    double seconds = stopwatch.get_duration() / 1e9;
+
+    size_t failures = 0;
+    for (size_t j = 0 ; j < jobs.size() ; ++j) {
+        Job &job = jobs[j];
+        const RomCase &rom = *job.rom;
+        const char *backend = backend_name(job.backend);
+
+        if (!job.loaded) {
+            SPDLOG_ERROR("FAIL {} ({}) : cannot be run.", rom.rom, backend);
+            ++failures;
+            continue;
+        }
+
+        bool ok = true;
+        for (size_t c = 0 ; c < rom.checkpoints.size() ; ++c) {
+            const Checkpoint &checkpoint = rom.checkpoints[c];
+
+            // Jobs of a case are contiguous, the reference one first.
+            uint64_t expected;
+            if (update)
+                expected = jobs[j - (j % backends.size())].hashes[c];
+            else if (checkpoint.hash)
+                expected = *checkpoint.hash;
+            else {
+                SPDLOG_ERROR("FAIL {} ({}) : no golden hash at frame {}, see --update.",
+                    rom.rom, backend, checkpoint.frame);
+                ok = false;
+                continue;
+            }
+
+            if (job.hashes[c] != expected) {
+                SPDLOG_ERROR("FAIL {} ({}) : frame {} hash is {:016x}, expected {:016x}.",
+                    rom.rom, backend, checkpoint.frame, job.hashes[c], expected);
+                ok = false;
+            }
+        }
+
+        if (budgets && job.ms > rom.budget_ms) {
+            SPDLOG_ERROR("FAIL {} ({}) : took {:.1f} ms, budget is {} ms.",
+                rom.rom, backend, job.ms, rom.budget_ms);
+            ok = false;
+        }
+
+        if (ok)
+            SPDLOG_INFO("ok   {} ({}) {:.1f} ms", rom.rom, backend, job.ms);
+        else
+            ++failures;
+    }
+
+    if (update) {
+        for (size_t j = 0 ; j < jobs.size() ; j += backends.size()) {
+            RomCase &rom = manifest.cases[j / backends.size()];
+            for (size_t c = 0 ; c < rom.checkpoints.size() && jobs[j].loaded ; ++c)
+                rom.checkpoints[c].hash = jobs[j].hashes[c];
+        }
+
+        if (!manifest.save(manifest_path)) {
+            SPDLOG_ERROR("Failed to write '{}'.", manifest_path);
+            return 1;
+        }
+        SPDLOG_INFO("Wrote '{}'.", manifest_path);
+    }
+
+    SPDLOG_INFO("{} runs, {} failed, {:.3f} s on {} threads", jobs.size(), failures, seconds, pool.size());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,374 @@
+#include "spdlog/spdlog.h"
+
+#include "Chip8.hpp"
+#include "Disassembler.hpp"
+#include "files.hpp"
+#include "Hash.hpp"
+#include "Stopwatch.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace {
+
+using tools::chip8::Chip8;
+
+// Exposes the state to compare.
+class Machine : public Chip8 {
+    public:
+
+    /**
+     * @brief Describe the first difference with another machine.
+     */
+    std::string difference(Machine &other) {
+        if (get_pc() != other.get_pc())
+            return fmt::format("pc {:03x} != {:03x}", get_pc(), other.get_pc());
+        if (get_i() != other.get_i())
+            return fmt::format("I {:03x} != {:03x}", get_i(), other.get_i());
+
+        for (int i = 0 ; i < REGISTERS_SIZE ; ++i) {
+            if (get_v()[i] != other.get_v()[i])
+                return fmt::format("V{:X} {:02x} != {:02x}", i, get_v()[i], other.get_v()[i]);
+        }
+
+        if (!std::ranges::equal(get_stack(), other.get_stack()))
+            return "stack";
+        if (get_delay_timer() != other.get_delay_timer())
+            return "delay timer";
+        if (get_sound_timer() != other.get_sound_timer())
+            return "sound timer";
+
+        for (int addr = 0 ; addr < MEMORY_SIZE ; ++addr) {
+            if (get_memory(addr) != other.get_memory(addr))
+                return fmt::format("memory at {:03x} {:02x} != {:02x}",
+                    addr, get_memory(addr), other.get_memory(addr));
+        }
+
+        if (frame_hash() != other.frame_hash())
+            return "screen";
+        return "generator";
+    }
+};
+
+struct Options {
+    std::vector<std::string> roms;
+    std::vector<Chip8::Backend> backends = { Chip8::Backend::predecoded, Chip8::Backend::jit };
+    uint64_t programs = 10000;
+    uint64_t instructions = 10000;
+    uint32_t interval = 64;
+    std::string quirks;
+    uint64_t seed = 0;
+    unsigned threads = 0;
+    std::string output = "divergence.ch8";
+};
+
+// A program and what it is run with.
+struct Case {
+    std::vector<uint8_t> rom;
+    Chip8::Backend backend;
+    uint64_t seed;
+};
+
+// Where a case diverged.
+struct Divergence {
+    uint64_t executed;
+    std::string difference;
+};
+
+void usage() {
+    SPDLOG_INFO("Usage : chip8-diff [options] [rom names]");
+    SPDLOG_INFO("Runs the interpreter and faster backends side by side on random programs,");
+    SPDLOG_INFO("then on the given roms, and shrinks the first divergence found.");
+    SPDLOG_INFO("  --backend NAME      predecoded, jit or all (default all)");
+    SPDLOG_INFO("  --programs N        random programs (default 10000)");
+    SPDLOG_INFO("  --instructions N    instructions per program (default 10000)");
+    SPDLOG_INFO("  --interval N        instructions between two state comparisons (default 64)");
+    SPDLOG_INFO("  --quirks NAME       quirks profile");
+    SPDLOG_INFO("  --seed N            seed of the random programs (default 0)");
+    SPDLOG_INFO("  --threads N         threads, calling thread included (default all)");
+    SPDLOG_INFO("  --output PATH       where to write the shrunk program (default divergence.ch8)");
+}
+
+const char *backend_name(Chip8::Backend backend) {
+    switch (backend) {
+        case Chip8::Backend::interpreter:   return "interpreter";
+        case Chip8::Backend::predecoded:    return "predecoded";
+        case Chip8::Backend::jit:           return "jit";
+    }
+    return "";
+}
+
+// Opcode families with random operand bits.
+struct Family {
+    uint16_t opcode;
+    uint16_t operands;
+};
+
+// Instructions are random words, half of them from a family touching
+// memory, the stack or the screen, where backends differ the most.
+std::vector<uint8_t> random_program(uint64_t seed) {
+    static const Family families[] = {
+        { 0x00e0, 0x0000 }, { 0x00ee, 0x0000 }, { 0x1000, 0x0fff }, { 0x2000, 0x0fff },
+        { 0xa000, 0x0fff }, { 0xd000, 0x0fff }, { 0xf033, 0x0f00 }, { 0xf055, 0x0f00 },
+        { 0xf065, 0x0f00 }, { 0xf01e, 0x0f00 }
+    };
+
+    uint64_t state = seed;
+    auto next = [&state]() {
+        state = tools::chip8::mix64(state);
+        return state;
+    };
+
+    size_t length = 16 + next() % 240;
+    std::vector<uint8_t> rom(length * 2);
+    for (size_t i = 0 ; i < length ; ++i) {
+        uint64_t random = next();
+        uint16_t opcode = random;
+
+        if (random & (1ull << 32)) {
+            const Family &family = families[(random >> 40) % std::size(families)];
+            opcode = family.opcode | (opcode & family.operands);
+
+            // Jumps and calls mostly land on instructions of the program.
+            if (family.opcode == 0x1000 || family.opcode == 0x2000)
+                opcode = family.opcode | (PROGRAM_START + (random >> 48) % length * 2);
+        }
+
+        rom[i * 2] = opcode >> 8;
+        rom[i * 2 + 1] = opcode & 0xff;
+    }
+    return rom;
+}
+
+// Run exactly count instructions, whatever made run() stop.
+void run_exactly(Chip8 &cpu, uint32_t count) {
+    while (count > 0) {
+        Chip8::RunResult result = cpu.run(count);
+        if (result.executed == 0)
+            break;
+        count -= result.executed;
+    }
+}
+
+// Run a case on the interpreter and on its backend.
+// @return false if they agree for the whole run.
+bool diverges(const Case &test, const Options &options, Divergence &divergence) {
+    Machine reference, candidate;
+    Machine *machines[] = { &reference, &candidate };
+    Chip8::Backend backends[] = { Chip8::Backend::interpreter, test.backend };
+
+    for (int m = 0 ; m < 2 ; ++m) {
+        Machine &cpu = *machines[m];
+        if (!cpu.load_rom(test.rom))
+            return false;
+        if (!options.quirks.empty())
+            cpu.set_quirks_profile(options.quirks);
+        cpu.seed(test.seed);
+        cpu.set_backend(backends[m]);
+    }
+
+    uint64_t keys = test.seed;
+    for (uint64_t executed = 0 ; executed < options.instructions ; executed += options.interval) {
+        // Same keys on both sides, changed now and then.
+        keys = tools::chip8::mix64(keys);
+        if ((keys & 0x3) == 0) {
+            reference.set_keys(keys >> 16);
+            candidate.set_keys(keys >> 16);
+        }
+
+        run_exactly(reference, options.interval);
+        run_exactly(candidate, options.interval);
+        reference.decrease_timers();
+        candidate.decrease_timers();
+
+        if (reference.state_hash() != candidate.state_hash()) {
+            divergence.executed = executed + options.interval;
+            divergence.difference = reference.difference(candidate);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Blank instructions then drop the end of the rom while the case still diverges.
+Case shrink(Case test, Options options, Divergence &divergence) {
+    options.instructions = divergence.executed;
+
+    bool shrunk = true;
+    while (shrunk) {
+        shrunk = false;
+
+        for (size_t length = test.rom.size() / 2 ; length > 0 ; length /= 2) {
+            while (test.rom.size() > length) {
+                Case shorter = test;
+                shorter.rom.resize(test.rom.size() - length);
+                Divergence found;
+                if (!diverges(shorter, options, found))
+                    break;
+                test = shorter;
+                divergence = found;
+                shrunk = true;
+            }
+        }
+
+        for (size_t i = 0 ; i + 1 < test.rom.size() ; i += 2) {
+            if (test.rom[i] == 0 && test.rom[i + 1] == 0)
+                continue;
+            Case blanked = test;
+            blanked.rom[i] = 0;
+            blanked.rom[i + 1] = 0;
+            Divergence found;
+            if (diverges(blanked, options, found)) {
+                test = blanked;
+                divergence = found;
+                shrunk = true;
+            }
+        }
+    }
+
+    // The earliest comparison still failing.
+    for (options.instructions = options.interval ; ; options.instructions += options.interval) {
+        if (diverges(test, options, divergence))
+            break;
+    }
+    return test;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1 ; i < argc ; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--backend" && has_value) {
+            std::string name = argv[++i];
+            if (name == "all")
+                options.backends = { Chip8::Backend::predecoded, Chip8::Backend::jit };
+            else if (name == "predecoded")
+                options.backends = { Chip8::Backend::predecoded };
+            else if (name == "jit")
+                options.backends = { Chip8::Backend::jit };
+            else {
+                SPDLOG_ERROR("Unknown backend '{}'.", name);
+                return 1;
+            }
+        }
+        else if (arg == "--programs" && has_value)
+            options.programs = std::stoull(argv[++i]);
+        else if (arg == "--instructions" && has_value)
+            options.instructions = std::stoull(argv[++i]);
+        else if (arg == "--interval" && has_value)
+            options.interval = std::stoul(argv[++i]);
+        else if (arg == "--quirks" && has_value)
+            options.quirks = argv[++i];
+        else if (arg == "--seed" && has_value)
+            options.seed = std::stoull(argv[++i]);
+        else if (arg == "--threads" && has_value)
+            options.threads = std::stoul(argv[++i]);
+        else if (arg == "--output" && has_value)
+            options.output = argv[++i];
+        else if (arg.starts_with("--")) {
+            usage();
+            return 1;
+        }
+        else
+            options.roms.push_back(arg);
+    }
+
+    if (options.interval == 0) {
+        SPDLOG_ERROR("Interval must be at least 1.");
+        return 1;
+    }
+
+    std::vector<std::vector<uint8_t>> roms;
+    for (const std::string &path : options.roms) {
+        roms.push_back(tools::utils::files::read_binary_file(path));
+        if (roms.back().empty()) {
+            SPDLOG_ERROR("Failed to read rom '{}'.", path);
+            return 1;
+        }
+    }
+
+    // Random programs first, then the roms, each on every backend.
+    size_t backends = options.backends.size();
+    size_t count = (options.programs + roms.size()) * backends;
+
+    std::mutex mutex;
+    bool failed = false;
+    size_t first_failure = SIZE_MAX;
+    Case failure;
+    Divergence divergence;
+    std::atomic<uint64_t> executed = 0;
+
+    tools::utils::ThreadPool pool(options.threads);
+    tools::utils::Stopwatch stopwatch;
+
+    pool.parallel_for(count, 4, [&](size_t begin, size_t end) {
+        for (size_t c = begin ; c < end ; ++c) {
+            size_t program = c / backends;
+
+            Case test;
+            test.backend = options.backends[c % backends];
+            test.seed = tools::chip8::hash_term(options.seed, program);
+            if (program < options.programs)
+                test.rom = random_program(test.seed);
+            else
+                test.rom = roms[program - options.programs];
+
+            Divergence found;
+            bool diverged = diverges(test, options, found);
+            executed.fetch_add(2 * (diverged ? found.executed : options.instructions), std::memory_order_relaxed);
+
+            // Keep the first one in case order, whatever the thread timing.
+            if (diverged) {
+                std::lock_guard lock(mutex);
+                if (c < first_failure) {
+                    failed = true;
+                    first_failure = c;
+                    failure = test;
+                    divergence = found;
+                }
+            }
+        }
+    });
+
+    double seconds = stopwatch.get_duration() / 1e9;
+    SPDLOG_INFO("{} runs, {} instructions in {:.3f} s on {} threads ; {:.0f} instructions/s",
+        count, executed.load(), seconds, pool.size(), seconds > 0 ? executed.load() / seconds : 0.0);
+
+    if (!failed) {
+        SPDLOG_INFO("No divergence.");
+        return 0;
+    }
+
+    size_t program = first_failure / backends;
+    if (program < options.programs)
+        SPDLOG_ERROR("Random program {} diverges on {} after {} instructions : {}.",
+            program, backend_name(failure.backend), divergence.executed, divergence.difference);
+    else
+        SPDLOG_ERROR("Rom '{}' diverges on {} after {} instructions : {}.",
+            options.roms[program - options.programs], backend_name(failure.backend),
+            divergence.executed, divergence.difference);
+
+    Case shrunk = shrink(failure, options, divergence);
+
+    SPDLOG_ERROR("Shrunk to {} bytes, diverging after {} instructions : {}.",
+        shrunk.rom.size(), divergence.executed, divergence.difference);
+    // Memory past the rom is zero, an odd last byte is the start of an opcode.
+    for (size_t i = 0 ; i < shrunk.rom.size() ; i += 2) {
+        uint16_t opcode = shrunk.rom[i] << 8 | (i + 1 < shrunk.rom.size() ? shrunk.rom[i + 1] : 0);
+        if (opcode != 0)
+            SPDLOG_ERROR("  {:03X}  {:04X}  {}", PROGRAM_START + i, opcode, tools::chip8::disassemble(opcode));
+    }
+    SPDLOG_ERROR("Seed {}, interval {}, quirks '{}'.", shrunk.seed, options.interval, options.quirks);
+
+    if (tools::utils::files::write_binary_file(shrunk.rom, options.output))
+        SPDLOG_INFO("Wrote '{}'.", options.output);
+    return 1;
+}
@@ -0,0 +1,204 @@
+#include "spdlog/spdlog.h"
+
+#include "Explorer.hpp"
+#include "files.hpp"
+#include "Stopwatch.hpp"
+
+#include <cstring>
+#include <string>
+
+namespace {
+
+using tools::chip8::Explorer;
+
+void usage() {
+    SPDLOG_INFO("Usage : chip8-explorer [rom name] --target ADDR<op>VALUE [options]");
+    SPDLOG_INFO("  --target ADDR<op>VALUE  stop when the byte at ADDR compares to VALUE,");
+    SPDLOG_INFO("                          op is one of == != < <= > >=, e.g. 0x1f0>=3");
+    SPDLOG_INFO("  --search NAME           breadth or best (default breadth)");
+    SPDLOG_INFO("  --score ADDR            best first expands the highest byte at ADDR first");
+    SPDLOG_INFO("  --frames N              frames each input is held (default 1)");
+    SPDLOG_INFO("  --keys LIST             key masks to try, comma separated (default none and each key)");
+    SPDLOG_INFO("  --max-states N          distinct states to reach at most (default 1000000)");
+    SPDLOG_INFO("  --max-depth N           inputs in a sequence at most");
+    SPDLOG_INFO("  --cpu-freq N            instructions per second of emulated time (default 1000)");
+    SPDLOG_INFO("  --quirks NAME           quirks profile");
+    SPDLOG_INFO("  --seed N                seed of the random generator (default 0)");
+    SPDLOG_INFO("  --threads N             threads, calling thread included (default all)");
+}
+
+bool parse_target(const std::string &text, Explorer::Target &target) {
+    using Compare = Explorer::Compare;
+
+    // Longest operators first, "<" is a prefix of "<=".
+    static const std::pair<const char *, Compare> operators[] = {
+        { "==", Compare::equal },
+        { "!=", Compare::not_equal },
+        { "<=", Compare::less_equal },
+        { ">=", Compare::greater_equal },
+        { "<", Compare::less },
+        { ">", Compare::greater }
+    };
+
+    for (const auto &[symbol, compare] : operators) {
+        size_t position = text.find(symbol);
+        if (position == std::string::npos)
+            continue;
+
+        try {
+            target.addr = std::stoul(text.substr(0, position), nullptr, 0) & 0x0fff;
+            target.value = std::stoul(text.substr(position + strlen(symbol)), nullptr, 0);
+        }
+        catch (const std::exception &) {
+            break;
+        }
+        target.compare = compare;
+        return true;
+    }
+
+    SPDLOG_ERROR("Invalid target '{}'.", text);
+    return false;
+}
+
+std::vector<uint16_t> parse_keys(const std::string &text) {
+    std::vector<uint16_t> keys;
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos)
+            end = text.size();
+        keys.push_back(std::stoul(text.substr(begin, end - begin), nullptr, 0));
+        begin = end + 1;
+    }
+    return keys;
+}
+
+void log_inputs(const std::vector<uint16_t> &inputs, uint32_t frames) {
+    for (size_t step = 0 ; step < inputs.size() ; ++step)
+        SPDLOG_INFO("  frame {:>6} : keys {:04x}", step * frames, inputs[step]);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage();
+        return 0;
+    }
+
+    std::string rom_path = argv[1];
+    Explorer::Target target;
+    bool has_target = false;
+    Explorer::Search search = Explorer::Search::breadth_first;
+    int score = -1;
+    uint32_t frames = 1;
+    std::vector<uint16_t> keys;
+    uint64_t max_states = 1000000;
+    uint32_t max_depth = UINT32_MAX;
+    uint32_t cpu_freq = 1000;
+    std::string quirks;
+    uint64_t seed = 0;
+    unsigned threads = 0;
+
+    for (int i = 2 ; i < argc ; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--target" && has_value) {
+            if (!parse_target(argv[++i], target))
+                return 1;
+            has_target = true;
+        }
+        else if (arg == "--search" && has_value) {
+            std::string name = argv[++i];
+            if (name == "breadth")
+                search = Explorer::Search::breadth_first;
+            else if (name == "best")
+                search = Explorer::Search::best_first;
+            else {
+                SPDLOG_ERROR("Unknown search '{}'.", name);
+                return 1;
+            }
+        }
+        else if (arg == "--score" && has_value)
+            score = std::stoul(argv[++i], nullptr, 0) & 0x0fff;
+        else if (arg == "--frames" && has_value)
+            frames = std::stoul(argv[++i]);
+        else if (arg == "--keys" && has_value)
+            keys = parse_keys(argv[++i]);
+        else if (arg == "--max-states" && has_value)
+            max_states = std::stoull(argv[++i]);
+        else if (arg == "--max-depth" && has_value)
+            max_depth = std::stoul(argv[++i]);
+        else if (arg == "--cpu-freq" && has_value)
+            cpu_freq = std::stoul(argv[++i]);
+        else if (arg == "--quirks" && has_value)
+            quirks = argv[++i];
+        else if (arg == "--seed" && has_value)
+            seed = std::stoull(argv[++i]);
+        else if (arg == "--threads" && has_value)
+            threads = std::stoul(argv[++i]);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!has_target) {
+        usage();
+        return 1;
+    }
+
+    if (search == Explorer::Search::best_first && score < 0) {
+        SPDLOG_ERROR("Best first search needs --score.");
+        return 1;
+    }
+
+    std::vector<uint8_t> rom = tools::utils::files::read_binary_file(rom_path);
+    if (rom.empty()) {
+        SPDLOG_ERROR("Failed to read rom '{}'.", rom_path);
+        return 1;
+    }
+
+    Explorer explorer(threads);
+    if (!explorer.load_rom(rom))
+        return 1;
+
+    if (!quirks.empty() && !explorer.set_quirks_profile(quirks))
+        return 1;
+
+    explorer.seed(seed);
+    explorer.set_cpu_freq(cpu_freq);
+    explorer.set_frames_per_input(frames);
+    explorer.set_search(search);
+    if (score >= 0)
+        explorer.set_score(score);
+    if (!keys.empty())
+        explorer.set_inputs(keys);
+
+    tools::utils::Stopwatch stopwatch;
+    Explorer::Result result = explorer.explore(target, max_states, max_depth);
+    double seconds = stopwatch.get_duration() / 1e9;
+
+    if (result.found) {
+        SPDLOG_INFO("Target reached after {} inputs of {} frames :", result.inputs.size(), frames);
+        log_inputs(result.inputs, frames);
+    }
+    else {
+        SPDLOG_INFO("Target not reached.");
+    }
+
+    if (result.soft_locks > 0) {
+        SPDLOG_INFO("{} soft locks, the first one after {} inputs :",
+            result.soft_locks, result.soft_lock_inputs.size());
+        log_inputs(result.soft_lock_inputs, frames);
+    }
+
+    SPDLOG_INFO("{} states, {} duplicates, depth {}, {} threads",
+        result.states, result.duplicates, result.depth, explorer.threads());
+
+    if (seconds > 0)
+        SPDLOG_INFO("{:.3f} s ; {:.0f} states/s", seconds, (result.states + result.duplicates) / seconds);
+
+    return result.found ? 0 : 2;
+}
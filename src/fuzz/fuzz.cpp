@@ -0,0 +1,101 @@
+#include "Chip8.hpp"
+
+#include <cstdlib>
+
+// Instructions run per input.
+#define MAX_INSTRUCTIONS 4096
+
+// Instructions between two timer ticks, 1000 Hz spread over 60 frames.
+#define TIMER_PERIOD 16
+
+// Counters of (pc, next pc) edges, folded into this many buckets.
+#define EDGES (1 << 16)
+
+// libFuzzer reads this section as extra coverage counters,
+// so that edges of the chip8 program guide the fuzzer too.
+#ifdef __GNUC__
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t edges[EDGES];
+
+namespace {
+
+using tools::chip8::Chip8;
+using tools::chip8::RomImage;
+
+// Exposes what the harness checks.
+class Machine : public Chip8 {
+    public:
+
+    using Chip8::get_pc;
+    using Chip8::get_stack;
+};
+
+/**
+ * Input layout:
+ *   1 byte          number of key changes, low 4 bits
+ *   3 bytes each    instruction / TIMER_PERIOD, then the key mask, big endian
+ *   the rest        rom, loaded at PROGRAM_START
+ */
+class Fuzzer {
+    public:
+
+    Fuzzer() {
+        _pristine.seed(0);
+        _image = RomImage::create({});
+    }
+
+    int run(const uint8_t *data, size_t size) {
+        if (size < 1)
+            return 0;
+
+        size_t changes = data[0] & 0x0f;
+        size_t header = 1 + changes * 3;
+        if (size < header)
+            return 0;
+
+        // The image is rewritten in place and mapped again,
+        // no reset, allocation nor font copy.
+        if (!_image->write_rom(data + header, size - header))
+            return 0;
+        _cpu.copy_state(_pristine);
+        _cpu.load_rom(_image);
+
+        const uint8_t *change = data + 1;
+        size_t next_change = 0;
+
+        for (uint32_t executed = 0 ; executed < MAX_INSTRUCTIONS ; ++executed) {
+            if (next_change < changes && executed >= change[0] * TIMER_PERIOD) {
+                _cpu.set_keys(change[1] << 8 | change[2]);
+                change += 3;
+                ++next_change;
+            }
+
+            uint16_t pc = _cpu.get_pc();
+            _cpu.next_instruction();
+            ++edges[(pc * 0x9e37u ^ _cpu.get_pc()) & (EDGES - 1)];
+
+            if (_cpu.get_stack().size() > STACK_SIZE)
+                abort();
+
+            if (executed % TIMER_PERIOD == TIMER_PERIOD - 1)
+                _cpu.decrease_timers();
+        }
+
+        return 0;
+    }
+
+    private:
+
+    // State every input starts from.
+    Machine _pristine;
+    Machine _cpu;
+    std::shared_ptr<RomImage> _image;
+};
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static Fuzzer fuzzer;
+    return fuzzer.run(data, size);
+}
@@ -0,0 +1,46 @@
+#include "spdlog/spdlog.h"
+
+#include "files.hpp"
+#include "Stopwatch.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Built instead of libFuzzer's main when CHIP8_FUZZ is off.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        SPDLOG_INFO("Usage : chip8-fuzz [input files]");
+        SPDLOG_INFO("        chip8-fuzz --random N    run N random inputs and report executions/s");
+        return 0;
+    }
+
+    std::string arg = argv[1];
+    if (arg == "--random" && argc == 3) {
+        uint64_t count = std::stoull(argv[2]);
+        std::mt19937_64 generator(0);
+        std::vector<uint8_t> input;
+
+        tools::utils::Stopwatch stopwatch;
+        for (uint64_t i = 0 ; i < count ; ++i) {
+            input.resize(1 + generator() % 512);
+            for (uint8_t &byte : input)
+                byte = generator();
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+        }
+        double seconds = stopwatch.get_duration() / 1e9;
+
+        if (seconds > 0)
+            SPDLOG_INFO("{} inputs in {:.3f} s ; {:.0f} executions/s", count, seconds, count / seconds);
+        return 0;
+    }
+
+    for (int i = 1 ; i < argc ; ++i) {
+        std::vector<uint8_t> input = tools::utils::files::read_binary_file(argv[i]);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        SPDLOG_INFO("Ran '{}'.", argv[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,354 @@
+#include "spdlog/spdlog.h"
+
+#include "BatchEngine.hpp"
+#include "Chip8.hpp"
+#include "files.hpp"
+#include "Hash.hpp"
+#include "InputLog.hpp"
+#include "StateWriter.hpp"
+#include "Stopwatch.hpp"
+
+#include <string>
+
+namespace {
+
+// Exposes the machine state for the final report.
+class Machine : public tools::chip8::Chip8 {
+    public:
+
+    void log_state() {
+        const uint8_t *v = get_v();
+        std::string registers;
+        for (int i = 0 ; i < REGISTERS_SIZE ; ++i)
+            registers += fmt::format("{}{:02x}", i == 0 ? "" : " ", v[i]);
+
+        SPDLOG_INFO("pc = {:#05x} ; I = {:#05x} ; DT = {} ; ST = {} ; stack depth = {}",
+            get_pc(), get_i(), get_delay_timer(), get_sound_timer(), get_stack().size());
+        SPDLOG_INFO("V = {}", registers);
+    }
+};
+
+bool parse_backend(const std::string &name, tools::chip8::Chip8::Backend &backend) {
+    using Backend = tools::chip8::Chip8::Backend;
+
+    if (name == "interpreter")
+        backend = Backend::interpreter;
+    else if (name == "predecoded")
+        backend = Backend::predecoded;
+    else if (name == "jit")
+        backend = Backend::jit;
+    else {
+        SPDLOG_ERROR("Unknown backend '{}'.", name);
+        return false;
+    }
+    return true;
+}
+
+void usage() {
+    SPDLOG_INFO("Usage : chip8-headless [rom name] [options]");
+    SPDLOG_INFO("  --frames N          run N frames of 1/60 s (default 600)");
+    SPDLOG_INFO("  --instructions N    run N instructions instead");
+    SPDLOG_INFO("  --cpu-freq N        instructions per second of emulated time (default 1000)");
+    SPDLOG_INFO("  --backend NAME      interpreter, predecoded or jit (default predecoded)");
+    SPDLOG_INFO("  --quirks NAME       quirks profile");
+    SPDLOG_INFO("  --fast-forward      skip delay timer waits instead of idling out the frame");
+    SPDLOG_INFO("  --seed N            seed of the random generator (default 0)");
+    SPDLOG_INFO("  --instances N       run N copies of the rom on a thread pool, frames only");
+    SPDLOG_INFO("  --threads N         threads of the pool, calling thread included (default all)");
+    SPDLOG_INFO("  --lockstep          step instances in groups sharing their registers, see Lockstep");
+    SPDLOG_INFO("  --load-state PATH   start from a state saved with --save-state");
+    SPDLOG_INFO("  --save-state PATH   save the state at the end");
+    SPDLOG_INFO("  --save-every N      also save it every N frames, at PATH.frame, from another thread");
+    SPDLOG_INFO("  --record PATH       write the inputs of the run to replay it with --replay");
+    SPDLOG_INFO("  --replay PATH       replay a recorded run and check that it ends in the same state");
+}
+
+struct Options {
+    std::string rom;
+    uint64_t frames = 600;
+    uint64_t instructions = 0;
+    uint32_t cpu_freq = 1000;
+    tools::chip8::Chip8::Backend backend = tools::chip8::Chip8::Backend::predecoded;
+    std::string quirks;
+    bool fast_forward = false;
+    uint64_t seed = 0;
+    size_t instances = 0;
+    unsigned threads = 0;
+    bool lockstep = false;
+    std::string load_state;
+    std::string save_state;
+    uint64_t save_every = 0;
+    std::string record;
+    std::string replay;
+};
+
+int run_batch(const Options &options) {
+    using tools::chip8::BatchEngine;
+
+    std::vector<uint8_t> rom = tools::utils::files::read_binary_file(options.rom);
+    if (rom.empty()) {
+        SPDLOG_ERROR("Failed to read rom '{}'.", options.rom);
+        return 1;
+    }
+
+    BatchEngine engine(options.instances, options.threads);
+    if (!engine.load_rom(rom))
+        return 1;
+
+    if (!options.quirks.empty() && !engine.set_quirks_profile(options.quirks))
+        return 1;
+
+    engine.seed(options.seed);
+    engine.set_backend(options.backend);
+    engine.set_cpu_freq(options.cpu_freq);
+    engine.set_fast_forward(options.fast_forward);
+    engine.set_lockstep(options.lockstep);
+
+    tools::utils::Stopwatch stopwatch;
+    engine.step(options.frames);
+    double seconds = stopwatch.get_duration() / 1e9;
+
+    // Order independent, identical for any number of threads.
+    uint64_t executed = 0, halted = 0, hash = 0, owned_pages = 0;
+    for (size_t i = 0 ; i < engine.size() ; ++i) {
+        BatchEngine::Slot &slot = engine.slot(i);
+        executed += slot.executed;
+        halted += slot.halted;
+        owned_pages += slot.cpu.get_owned_pages();
+        hash ^= tools::chip8::hash_term(i, slot.cpu.frame_hash());
+    }
+
+    SPDLOG_INFO("batch hash = {:016x}", hash);
+    SPDLOG_INFO("{} instances on {} threads, {} instructions, {} halted",
+        engine.size(), engine.threads(), executed, halted);
+
+    SPDLOG_INFO("memory : {} B per instance, {:.1f} written pages of {} B per instance",
+        sizeof(BatchEngine::Slot), (double)owned_pages / engine.size(), MEMORY_PAGE_SIZE);
+
+    if (options.lockstep && executed > 0)
+        SPDLOG_INFO("lockstep : {:.1f}% of instructions", 100.0 * engine.get_lockstep_count() / executed);
+
+    if (seconds > 0)
+        SPDLOG_INFO("{:.3f} s ; {:.0f} instructions/s ; {:.0f} instance frames/s",
+            seconds, executed / seconds, engine.size() * options.frames / seconds);
+
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    using tools::chip8::Chip8;
+    using StopReason = Chip8::StopReason;
+
+    if (argc < 2) {
+        usage();
+        return 0;
+    }
+
+    Options options;
+    options.rom = argv[1];
+
+    for (int i = 2 ; i < argc ; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--frames" && has_value)
+            options.frames = std::stoull(argv[++i]);
+        else if (arg == "--instructions" && has_value)
+            options.instructions = std::stoull(argv[++i]);
+        else if (arg == "--cpu-freq" && has_value)
+            options.cpu_freq = std::stoul(argv[++i]);
+        else if (arg == "--backend" && has_value) {
+            if (!parse_backend(argv[++i], options.backend))
+                return 1;
+        }
+        else if (arg == "--quirks" && has_value)
+            options.quirks = argv[++i];
+        else if (arg == "--fast-forward")
+            options.fast_forward = true;
+        else if (arg == "--seed" && has_value)
+            options.seed = std::stoull(argv[++i]);
+        else if (arg == "--instances" && has_value)
+            options.instances = std::stoull(argv[++i]);
+        else if (arg == "--threads" && has_value)
+            options.threads = std::stoul(argv[++i]);
+        else if (arg == "--lockstep")
+            options.lockstep = true;
+        else if (arg == "--load-state" && has_value)
+            options.load_state = argv[++i];
+        else if (arg == "--save-state" && has_value)
+            options.save_state = argv[++i];
+        else if (arg == "--save-every" && has_value)
+            options.save_every = std::stoull(argv[++i]);
+        else if (arg == "--record" && has_value)
+            options.record = argv[++i];
+        else if (arg == "--replay" && has_value)
+            options.replay = argv[++i];
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (options.cpu_freq < 60) {
+        SPDLOG_ERROR("CPU frequency must be at least 60 Hz.");
+        return 1;
+    }
+
+    if (options.save_every > 0 && options.save_state.empty()) {
+        SPDLOG_ERROR("--save-every needs --save-state.");
+        return 1;
+    }
+
+    // Skipped timer ticks are not events of the log.
+    if (!options.record.empty() && options.fast_forward) {
+        SPDLOG_ERROR("--record cannot be used with --fast-forward.");
+        return 1;
+    }
+
+    if (options.instances > 0)
+        return run_batch(options);
+
+    std::string rom = options.rom;
+    uint64_t frames = options.frames;
+    uint64_t instructions = options.instructions;
+    uint32_t cpu_freq = options.cpu_freq;
+    bool fast_forward = options.fast_forward;
+
+    Machine cpu;
+    if (!cpu.load_rom(rom)) {
+        SPDLOG_ERROR("Failed to load rom '{}'.", rom);
+        return 1;
+    }
+
+    if (!options.quirks.empty() && !cpu.set_quirks_profile(options.quirks))
+        return 1;
+
+    cpu.seed(options.seed);
+    cpu.set_backend(options.backend);
+
+    Chip8::State state;
+    if (!options.load_state.empty()) {
+        if (!state.load(options.load_state))
+            return 1;
+        cpu.load_state(state);
+    }
+
+    tools::chip8::StateWriter writer;
+
+    tools::chip8::InputLog log;
+    if (!options.replay.empty()) {
+        if (!log.load(options.replay))
+            return 1;
+
+        tools::utils::Stopwatch stopwatch;
+        bool same = log.replay(cpu);
+        double seconds = stopwatch.get_duration() / 1e9;
+
+        cpu.log_state();
+        SPDLOG_INFO("frame hash = {:016x}", cpu.frame_hash());
+        SPDLOG_INFO("{} instructions, {} events{}", cpu.get_instructions(), log.get_events().size(),
+            same ? ", same final state" : "");
+        SPDLOG_INFO("{:.3f} s", seconds);
+        return same ? 0 : 1;
+    }
+
+    if (!options.record.empty())
+        log.start(cpu);
+
+    // Without an instruction target, run the frame count.
+    if (instructions == 0)
+        instructions = UINT64_MAX;
+    else
+        frames = UINT64_MAX;
+
+    uint64_t executed = 0, frame = 0, idle = 0, skipped_frames = 0;
+    uint32_t remainder = 0;
+    bool halted = false;
+
+    tools::utils::Stopwatch stopwatch;
+
+    while (frame < frames && executed < instructions && !halted) {
+        uint64_t previous = frame;
+
+        // Spread cpu_freq instructions over 60 frames without drifting.
+        remainder += cpu_freq;
+        uint64_t budget = remainder / 60;
+        remainder %= 60;
+
+        if (budget > instructions - executed)
+            budget = instructions - executed;
+
+        while (budget > 0) {
+            Chip8::RunResult result = cpu.run(budget);
+            executed += result.executed;
+            budget -= result.executed;
+
+            if (result.reason == StopReason::halt_loop) {
+                halted = true;
+                break;
+            }
+            else if (result.reason == StopReason::idle && fast_forward) {
+                // The skipped timer ticks are emulated frames too,
+                // stop short of the last one, it ends below.
+                uint64_t left = frames - frame - 1;
+                uint8_t ticks = cpu.fast_forward_timers(left < 0xff ? left : 0xff);
+                skipped_frames += ticks;
+                frame += ticks;
+                if (ticks > 0)
+                    continue;
+            }
+
+            if (result.reason == StopReason::idle
+                || result.reason == StopReason::waiting_for_key) {
+                // No input will ever come, nothing happens until the next frame.
+                idle += budget;
+                break;
+            }
+        }
+
+        cpu.decrease_timers();
+        log.record_timers(cpu);
+        ++frame;
+
+        // Fast forward may step over a multiple of save_every.
+        if (options.save_every > 0 && frame / options.save_every > previous / options.save_every) {
+            cpu.save_state(state);
+            writer.write(state, fmt::format("{}.{}", options.save_state, frame));
+        }
+    }
+
+    double seconds = stopwatch.get_duration() / 1e9;
+
+    if (!options.record.empty()) {
+        log.stop(cpu);
+        if (!log.save(options.record))
+            return 1;
+    }
+
+    if (!options.save_state.empty()) {
+        cpu.save_state(state);
+        if (!state.save(options.save_state))
+            return 1;
+    }
+
+    writer.flush();
+    if (writer.get_dropped() > 0 || writer.get_failed() > 0)
+        SPDLOG_WARN("states : {} written, {} dropped, {} failed",
+            writer.get_written(), writer.get_dropped(), writer.get_failed());
+
+    cpu.log_state();
+    SPDLOG_INFO("frame hash = {:016x}", cpu.frame_hash());
+    SPDLOG_INFO("{} instructions in {} frames ({} skipped){}", executed, frame,
+        skipped_frames, halted ? ", halted" : "");
+
+    if (executed + idle > 0)
+        SPDLOG_INFO("idle : {:.1f}%", 100.0 * idle / (executed + idle));
+
+    if (seconds > 0)
+        SPDLOG_INFO("{:.3f} s ; {:.0f} instructions/s ; {:.0f} frames/s",
+            seconds, executed / seconds, frame / seconds);
+
+    return 0;
+}
@@ -7,6 +7,8 @@
 #include "Chip8.hpp"
 
 #include "files.hpp"
+#include "InputLog.hpp"
+#include "Rewind.hpp"
 #include "Scheduler.hpp"
 #include "Stopwatch.hpp"
 
@@ -14,6 +16,9 @@
 #include "sdl/Sound.hpp"
 #include "sdl/Window.hpp"
 
+#include <bit>
+#include <cstring>
+
 void log_init() {
     #ifdef DEBUG
     spdlog::set_level(spdlog::level::debug);
@@ -23,8 +28,8 @@ void log_init() {
 int main(int argc, char **argv) {
     log_init();
 
-    if (argc < 2 || argc > 5) {
-        SPDLOG_INFO("Usage : chip8 [rom name] [cpu freq] [background color hex] [foreground color hex]");
+    if (argc < 2 || argc > 7) {
+        SPDLOG_INFO("Usage : chip8 [rom name] [cpu freq] [background color hex] [foreground color hex] [quirks profile] [run ahead frames]");
         return 0;
     }
 
@@ -55,7 +60,7 @@ int main(int argc, char **argv) {
     uint16_t timer_freq = 60;
     uint16_t display_freq = 30;
 
-    uint64_t cpu_count = 0, timer_count = 0, display_count = 0;
+    uint64_t cpu_count = 0, timer_count = 0, display_count = 0, idle_count = 0;
 
     tools::chip8::Chip8 cpu;
     if (!cpu.load_rom(rom)) {
@@ -63,6 +68,14 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    if (argc >= 6 && argv[5][0] != '\0' && !cpu.set_quirks_profile(argv[5]))
+        exit(1);
+
+    // Frames run ahead of the presented one, see the emulation task.
+    int run_ahead = 0;
+    if (argc >= 7)
+        run_ahead = std::stoi(argv[6]);
+
     uint8_t pixel_width = 16;
     uint8_t pixel_height = 20;
 
@@ -98,10 +111,71 @@ int main(int argc, char **argv) {
 
     tools::utils::Scheduler scheduler;
 
+    using StopReason = tools::chip8::Chip8::StopReason;
+
+    // Set when the screen needs to be rendered again.
+    bool screen_updated = true;
+
+    // Screen rendered by the SDL task, ahead of the machine with run-ahead.
+    uint64_t presented[HEIGHT] = {};
+    auto present = [&](const uint64_t *screen) {
+        if (memcmp(presented, screen, sizeof(presented)) != 0) {
+            memcpy(presented, screen, sizeof(presented));
+            screen_updated = true;
+        }
+    };
+
+    // Every frame is recorded, stepped back while backspace is held.
+    tools::chip8::Rewind rewind;
+    tools::chip8::Chip8::State state;
+    bool rewinding = false;
+
+    // Inputs recorded while F9 is toggled on, see chip8-headless --replay.
+    tools::chip8::InputLog input_log;
+    auto stop_recording = [&]() {
+        input_log.stop(cpu);
+        if (input_log.save("chip8.replay"))
+            SPDLOG_INFO("Inputs written to 'chip8.replay'.");
+    };
+
+    // The sound plays while the timer is set. StopReason::sound_timer only
+    // reports changes made by the program, restored states are checked here.
+    auto update_sound = [&]() {
+        if (cpu.get_sound_timer() > 0)
+            sound_player.play();
+        else
+            sound_player.pause();
+    };
+
     tools::utils::Stopwatch loop_stopwatch("loop");
     uint64_t previous = 0;
     double n_inst_remainder = 0;
 
+    // Execute n_inst instructions,
+    // reacting to what the program did when it stops early.
+    // Frames run ahead are not played nor counted, see run_ahead.
+    auto run_instructions = [&](uint32_t remaining, bool speculative = false) {
+        while (remaining > 0) {
+            auto result = cpu.run(remaining);
+            remaining -= result.executed;
+            if (!speculative)
+                cpu_count += result.executed;
+
+            if (result.reason == StopReason::sound_timer && !speculative) {
+                update_sound();
+            }
+            else if (result.reason == StopReason::waiting_for_key
+                || result.reason == StopReason::halt_loop
+                || result.reason == StopReason::idle) {
+                // Spinning until the next key event, timer tick or forever,
+                // the scheduler sleeps until the next task instead.
+                if (!speculative)
+                    idle_count += remaining;
+                break;
+            }
+        }
+    };
+
     tools::utils::Task emulation_task;
     emulation_task.name = "Emulation task";
     emulation_task.delay_ns = std::chrono::nanoseconds(1000000000 / timer_freq);
@@ -111,12 +185,22 @@ int main(int argc, char **argv) {
         double seconds_since_last_loop = (duration - previous) / 1e9;
         previous = duration;
 
-        // Decrease timers.
-        cpu.decrease_timers();
-        if (cpu.get_sound_timer() > 0)
-            sound_player.play();
-        else
+        if (rewinding) {
+            // One frame back per tick, as fast as it was played.
+            if (rewind.pop(state)) {
+                cpu.load_state(state);
+                present(cpu.get_screen_buffer());
+            }
+            // Silent while going back, the state reached plays again below.
             sound_player.pause();
+            return true;
+        }
+
+        // Decrease timers, the sound stops with the timer
+        // and starts again for a state restored by rewinding.
+        cpu.decrease_timers();
+        input_log.record_timers(cpu);
+        update_sound();
         ++timer_count;
 
         // Compute how many instructions we
@@ -138,10 +222,26 @@ int main(int argc, char **argv) {
             n_inst_remainder -= 1;
         }
 
-        // Execute n_inst instructions.
-        for (uint32_t i = 0 ; i < n_inst ; ++i) {
-            cpu.next_instruction();
-            ++cpu_count;
+        run_instructions(n_inst);
+
+        cpu.save_state(state);
+        rewind.push(state);
+
+        // Traces only hold the instructions that really ran.
+        if (run_ahead > 0 && !cpu.is_tracing()) {
+            // Show what the game draws run_ahead frames later with the keys held now,
+            // which hides the frames it takes to react to them, then go back.
+            // Restoring only copies the pages the speculative frames wrote.
+            for (int frame = 0 ; frame < run_ahead ; ++frame) {
+                cpu.decrease_timers();
+                run_instructions(n_inst, true);
+            }
+            present(cpu.get_screen_buffer());
+            cpu.load_state(state);
+            update_sound();
+        }
+        else {
+            present(cpu.get_screen_buffer());
         }
 
         return true;
@@ -158,15 +258,49 @@ int main(int argc, char **argv) {
             if (event.type == SDL_QUIT) {
                 scheduler.stop();
             }
+            else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F7) {
+                if (cpu.is_tracing()) {
+                    cpu.disable_trace();
+                    SPDLOG_INFO("Tracing disabled.");
+                }
+                else {
+                    cpu.enable_trace();
+                    SPDLOG_INFO("Tracing enabled.");
+                }
+            }
+            else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F8) {
+                if (cpu.dump_trace("chip8.trace"))
+                    SPDLOG_INFO("Trace written to 'chip8.trace'.");
+            }
+            else if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+                && event.key.keysym.sym == SDLK_BACKSPACE) {
+                rewinding = event.type == SDL_KEYDOWN;
+                // The log cannot follow the machine back in time.
+                if (rewinding && input_log.is_recording())
+                    stop_recording();
+            }
+            else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F9) {
+                if (input_log.is_recording()) {
+                    stop_recording();
+                }
+                else {
+                    input_log.start(cpu);
+                    SPDLOG_INFO("Recording inputs.");
+                }
+            }
             else if (event.type == SDL_KEYDOWN) {
                 int mapped = mapper.map_key(event.key.keysym.sym);
-                if (mapped != -1)
+                if (mapped != -1) {
                     cpu.key_pressed(mapped);
+                    input_log.record_keys(cpu);
+                }
             }
             else if (event.type == SDL_KEYUP) {
                 int mapped = mapper.map_key(event.key.keysym.sym);
-                if (mapped != -1)
+                if (mapped != -1) {
                     cpu.key_released(mapped);
+                    input_log.record_keys(cpu);
+                }
             }
             else if (event.type == SDL_WINDOWEVENT) {
                 if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
@@ -174,19 +308,26 @@ int main(int argc, char **argv) {
                     pixel_height = event.window.data2 / HEIGHT;
                     rect.w = pixel_width;
                     rect.h = pixel_height;
+                    screen_updated = true;
                 }
             }
         }
 
+        if (!screen_updated)
+            return true;
+        screen_updated = false;
+
         w.set_draw_color(back_red, back_green, back_blue);
         w.clear();
         w.set_draw_color(front_red, front_green, front_blue);
 
-        auto screen = cpu.get_screen_buffer();
-        for (int i = 0 ; i < SCREEN_SIZE ; ++i) {
-            if (screen[i]) {
-                uint8_t y = (i / WIDTH);
-                uint8_t x = i - (y * WIDTH);
+        const uint64_t *screen = presented;
+        for (int y = 0 ; y < HEIGHT ; ++y) {
+            // Walk the lit pixels of the row, leftmost first.
+            uint64_t row = screen[y];
+            while (row) {
+                int x = std::countl_zero(row);
+                row &= ~(0x8000000000000000ull >> x);
                 rect.x = x * pixel_width;
                 rect.y = y * pixel_height;
                 w.draw_rectangle(&rect, true);
@@ -205,10 +346,14 @@ int main(int argc, char **argv) {
     loop_stopwatch.reset();
     scheduler.start();
 
+    if (input_log.is_recording())
+        stop_recording();
+
     uint64_t duration = stopwatch.get_duration();
     SPDLOG_INFO("cpu = {}/s", 1e9 * cpu_count / duration);
     SPDLOG_INFO("timer = {}/s", 1e9 * timer_count / duration);
     SPDLOG_INFO("display = {}/s", 1e9 * display_count / duration);
+    SPDLOG_INFO("idle = {:.1f}%", 100.0 * idle_count / std::max<uint64_t>(cpu_count + idle_count, 1));
 
     return 0;
 }
\ No newline at end of file
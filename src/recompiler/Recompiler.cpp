@@ -0,0 +1,315 @@
+#include "recompiler/Recompiler.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include "Chip8.hpp"
+#include "Disassembler.hpp"
+#include "files.hpp"
+
+namespace tools::chip8::recompiler {
+
+Recompiler::Recompiler() {}
+Recompiler::~Recompiler() {}
+
+bool Recompiler::load_rom(const std::string &path) {
+    _rom = tools::utils::files::read_binary_file(path);
+    if (_rom.empty()) {
+        SPDLOG_ERROR("Failed to load rom file '{}'.", path);
+        return false;
+    }
+
+    _path = path;
+    return true;
+}
+
+bool Recompiler::set_quirks_profile(const std::string &name) {
+    auto quirks = quirks_from_profile(name);
+    if (!quirks) {
+        SPDLOG_ERROR("Unknown quirks profile '{}'.", name);
+        return false;
+    }
+
+    _profile = name;
+    _quirks = *quirks;
+    return true;
+}
+
+void Recompiler::analyze() {
+    _leaders.clear();
+    _reached.reset();
+    _code_start = PROGRAM_START;
+    _code_end = PROGRAM_START;
+
+    std::vector<uint16_t> worklist;
+    add_target(PROGRAM_START, worklist);
+
+    while (!worklist.empty()) {
+        uint16_t addr = worklist.back();
+        worklist.pop_back();
+
+        // Follow the instructions until the end of the block.
+        while (in_rom(addr) && !_reached[addr]) {
+            _reached[addr] = true;
+            _code_end = std::max<uint16_t>(_code_end, addr + 2);
+
+            uint16_t op = opcode(addr);
+            uint8_t msb = op >> 12;
+            uint8_t const8 = op & 0x00ff;
+
+            if (msb == 0x1) {
+                add_target(op & 0x0fff, worklist);
+            }
+            else if (msb == 0x2) {
+                add_target(op & 0x0fff, worklist);
+                add_target(addr + 2, worklist);
+            }
+            else if (msb == 0xf && const8 == 0x0a) {
+                // Waiting for a key executes the instruction again.
+                add_target(addr, worklist);
+                add_target(addr + 2, worklist);
+            }
+            else if (is_terminator(op) && msb != 0x0 && msb != 0xb) {
+                // Skips.
+                add_target(addr + 2, worklist);
+                add_target(addr + 4, worklist);
+            }
+
+            if (is_terminator(op))
+                break;
+
+            addr += 2;
+        }
+    }
+
+    SPDLOG_INFO("Found {} blocks, {} instructions.", _leaders.size(), _reached.count());
+}
+
+std::string Recompiler::emit(const std::string &name) {
+    std::string out = fmt::format(
+        "// Generated by chip8-recompiler from '{}', do not edit.\n"
+        "#include \"recompiler/Runtime.hpp\"\n"
+        "\n"
+        "#include <memory>\n"
+        "\n"
+        "namespace {{\n"
+        "\n"
+        "const std::vector<uint8_t> rom = {{",
+        _path);
+
+    for (size_t i = 0 ; i < _rom.size() ; ++i) {
+        if (i % 16 == 0)
+            out += "\n    ";
+        out += fmt::format("0x{:02x},", _rom[i]);
+    }
+
+    out += fmt::format(
+        "\n}};\n"
+        "\n"
+        "class {0} : public tools::chip8::recompiler::Runtime {{\n"
+        "    public:\n"
+        "\n"
+        "    {0}() : Runtime(rom, 0x{1:03X}, 0x{2:03X}) {{\n"
+        "        set_quirks_profile(\"{3}\");\n"
+        "    }}\n"
+        "\n"
+        "    uint32_t run_native(uint32_t budget) override {{\n"
+        "        uint8_t *V = v();\n"
+        "        uint16_t &I = i();\n"
+        "        uint32_t executed = 0;\n"
+        "\n"
+        "        while (executed < budget) {{\n"
+        "            if (!is_native()) {{\n"
+        "                interpret();\n"
+        "                ++executed;\n"
+        "                continue;\n"
+        "            }}\n"
+        "\n"
+        "            switch (pc()) {{\n",
+        name, _code_start, _code_end, _profile);
+
+    for (uint16_t leader : _leaders) {
+        if (_reached[leader])
+            out += emit_block(leader);
+    }
+
+    out += fmt::format(
+        "                default:\n"
+        "                    break;\n"
+        "            }}\n"
+        "\n"
+        "            // Not recompiled or not enough budget left for the block.\n"
+        "            interpret();\n"
+        "            ++executed;\n"
+        "        }}\n"
+        "\n"
+        "        (void)V;\n"
+        "        (void)I;\n"
+        "        return executed;\n"
+        "    }}\n"
+        "}};\n"
+        "\n"
+        "}} // namespace\n"
+        "\n"
+        "std::unique_ptr<tools::chip8::recompiler::Runtime> make_{0}() {{\n"
+        "    return std::make_unique<{0}>();\n"
+        "}}\n",
+        name);
+
+    return out;
+}
+
+bool Recompiler::write(const std::string &name, const std::string &path) {
+    std::string source = emit(name);
+    std::vector<uint8_t> data(source.begin(), source.end());
+    return tools::utils::files::write_binary_file(data, path);
+}
+
+uint16_t Recompiler::opcode(uint16_t addr) {
+    uint16_t offset = addr - PROGRAM_START;
+    return (_rom[offset] << 8) | _rom[offset + 1];
+}
+
+bool Recompiler::in_rom(uint16_t addr) {
+    return addr >= PROGRAM_START && addr + 1u < PROGRAM_START + _rom.size();
+}
+
+void Recompiler::add_target(uint16_t addr, std::vector<uint16_t> &worklist) {
+    if (!in_rom(addr))
+        return;
+
+    _leaders.insert(addr);
+    worklist.push_back(addr);
+}
+
+bool Recompiler::is_terminator(uint16_t opcode) {
+    uint8_t const8 = opcode & 0x00ff;
+    switch (opcode >> 12) {
+        case 0x0: return opcode == 0x00ee;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xb: return true;
+        case 0xe: return const8 == 0x9e || const8 == 0xa1;
+        case 0xf: return const8 == 0x0a;
+        default: return false;
+    }
+}
+
+std::string Recompiler::emit_block(uint16_t start) {
+    std::vector<uint16_t> addrs;
+    uint16_t addr = start;
+    bool terminated = false;
+
+    do {
+        addrs.push_back(addr);
+        terminated = is_terminator(opcode(addr));
+        addr += 2;
+    } while (!terminated && _reached[addr] && !_leaders.contains(addr));
+
+    uint16_t length = addrs.size();
+    std::string out = fmt::format(
+        "                case 0x{:03X}:\n"
+        "                    if (budget - executed < {})\n"
+        "                        break;\n"
+        "                    executed += {};\n",
+        start, length, length);
+
+    for (uint16_t k = 0 ; k < length ; ++k)
+        out += emit_instruction(addrs[k], opcode(addrs[k]), length - k - 1);
+
+    // Fall through to the next block.
+    if (!terminated)
+        out += fmt::format("                    pc() = 0x{:03X};\n", addr);
+
+    out += "                    continue;\n";
+    return out;
+}
+
+std::string Recompiler::emit_instruction(uint16_t addr, uint16_t opcode, uint16_t remaining) {
+    uint8_t x = (opcode >> 8) & 0x000f;
+    uint8_t y = (opcode >> 4) & 0x000f;
+    uint8_t const8 = opcode & 0x00ff;
+    uint16_t nnn = opcode & 0x0fff;
+    uint16_t next = addr + 2;
+    uint16_t skip = addr + 4;
+
+    std::string out = fmt::format("                    // 0x{:03X}: {}\n", addr, disassemble(opcode));
+    std::string code;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00ee)
+                code = fmt::format("pc() = pop(0x{:03X});", next);
+            break;
+        case 0x1: code = fmt::format("pc() = 0x{:03X};", nnn); break;
+        case 0x2: code = fmt::format("pc() = push(0x{0:03X}) ? 0x{1:03X} : 0x{0:03X};", next, nnn); break;
+        case 0x3: code = fmt::format("pc() = V[0x{:X}] == 0x{:02X} ? 0x{:03X} : 0x{:03X};", x, const8, skip, next); break;
+        case 0x4: code = fmt::format("pc() = V[0x{:X}] != 0x{:02X} ? 0x{:03X} : 0x{:03X};", x, const8, skip, next); break;
+        case 0x5: code = fmt::format("pc() = V[0x{:X}] == V[0x{:X}] ? 0x{:03X} : 0x{:03X};", x, y, skip, next); break;
+        case 0x6: code = fmt::format("V[0x{:X}] = 0x{:02X};", x, const8); break;
+        case 0x7: code = fmt::format("V[0x{:X}] += 0x{:02X};", x, const8); break;
+        case 0x8:
+            // VF is written in the same order as the interpreter.
+            switch (opcode & 0x000f) {
+                case 0x0: code = fmt::format("V[0x{:X}] = V[0x{:X}];", x, y); break;
+                case 0x1: code = fmt::format("V[0x{:X}] |= V[0x{:X}];", x, y); break;
+                case 0x2: code = fmt::format("V[0x{:X}] &= V[0x{:X}];", x, y); break;
+                case 0x3: code = fmt::format("V[0x{:X}] ^= V[0x{:X}];", x, y); break;
+                case 0x4: code = fmt::format("{{ uint16_t r = V[0x{0:X}] + V[0x{1:X}]; V[0xF] = r > 0xff; V[0x{0:X}] = r; }}", x, y); break;
+                case 0x5: code = fmt::format("V[0xF] = V[0x{1:X}] > V[0x{0:X}] ? 0 : 1; V[0x{0:X}] -= V[0x{1:X}];", x, y); break;
+                case 0x6:
+                    if (_quirks.shift_vy)
+                        code = fmt::format("{{ uint8_t vy = V[0x{1:X}]; V[0xF] = vy & 0x1; V[0x{0:X}] = vy >> 1; }}", x, y);
+                    else
+                        code = fmt::format("V[0xF] = V[0x{0:X}] & 0x1; V[0x{0:X}] >>= 1;", x);
+                    break;
+                case 0x7: code = fmt::format("V[0xF] = V[0x{0:X}] > V[0x{1:X}] ? 0 : 1; V[0x{0:X}] = V[0x{1:X}] - V[0x{0:X}];", x, y); break;
+                case 0xe:
+                    if (_quirks.shift_vy)
+                        code = fmt::format("{{ uint8_t vy = V[0x{1:X}]; V[0xF] = (vy >> 7) & 0x1; V[0x{0:X}] = vy << 1; }}", x, y);
+                    else
+                        code = fmt::format("V[0xF] = (V[0x{0:X}] >> 7) & 0x1; V[0x{0:X}] <<= 1;", x);
+                    break;
+                default: break;
+            }
+            if (_quirks.vf_reset && (opcode & 0x000f) >= 0x1 && (opcode & 0x000f) <= 0x3)
+                code += " V[0xF] = 0;";
+            break;
+        case 0x9: code = fmt::format("pc() = V[0x{:X}] != V[0x{:X}] ? 0x{:03X} : 0x{:03X};", x, y, skip, next); break;
+        case 0xa: code = fmt::format("I = 0x{:03X};", nnn); break;
+        case 0xb: code = fmt::format("pc() = V[0x{:X}] + 0x{:03X};", _quirks.jump_vx ? x : 0, nnn); break;
+        case 0xe:
+            // Skips depending on keys, the interpreter moves pc.
+            code = fmt::format("pc() = 0x{:03X}; execute(0x{:04X});", next, opcode);
+            break;
+        case 0xf:
+            if (const8 == 0x1e) {
+                code = fmt::format("I += V[0x{:X}];", x);
+            }
+            else if (const8 == 0x0a) {
+                code = fmt::format("pc() = 0x{:03X}; execute(0x{:04X});", next, opcode);
+            }
+            else if (const8 == 0x33 || const8 == 0x55) {
+                // Writes to memory may hit the recompiled code.
+                code = fmt::format("execute(0x{:04X}); if (!is_native()) {{ pc() = 0x{:03X}; executed -= {}; continue; }}",
+                    opcode, next, remaining);
+            }
+            else {
+                code = fmt::format("execute(0x{:04X});", opcode);
+            }
+            break;
+        default:
+            code = fmt::format("execute(0x{:04X});", opcode);
+            break;
+    }
+
+    if (code.empty())
+        code = fmt::format("execute(0x{:04X});", opcode);
+
+    return out + "                    " + code + "\n";
+}
+
+} // namespace tools::chip8::recompiler
@@ -0,0 +1,79 @@
+#ifndef RECOMPILER_HPP
+#define RECOMPILER_HPP
+
+#include <bitset>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Quirks.hpp"
+
+namespace tools::chip8::recompiler {
+
+/**
+ * Translates a rom into C++ source code running on top of Runtime.
+ * Code reachable from PROGRAM_START is split into basic blocks, computed
+ * jumps (Bnnn) and anything not found statically are left to the interpreter.
+ */
+class Recompiler {
+    public:
+
+    Recompiler();
+    ~Recompiler();
+
+    bool load_rom(const std::string &path);
+
+    /**
+     * @brief Generate code for the quirks of a profile, see quirks_profiles().
+     * @return false if the profile is unknown.
+     */
+    bool set_quirks_profile(const std::string &name);
+
+    /**
+     * @brief Recover the control flow graph of the loaded rom.
+     */
+    void analyze();
+
+    /**
+     * @brief Generate the C++ source of the recompiled rom.
+     * @param name Name of the generated class, the factory is called make_<name>().
+     * @return The source code.
+     */
+    std::string emit(const std::string &name);
+
+    bool write(const std::string &name, const std::string &path);
+
+    private:
+
+    uint16_t opcode(uint16_t addr);
+    bool in_rom(uint16_t addr);
+
+    void add_target(uint16_t addr, std::vector<uint16_t> &worklist);
+
+    // Whether the instruction ends a basic block.
+    static bool is_terminator(uint16_t opcode);
+
+    std::string emit_block(uint16_t start);
+    std::string emit_instruction(uint16_t addr, uint16_t opcode, uint16_t remaining);
+
+    std::string _path;
+
+    std::string _profile = "default";
+    Quirks _quirks;
+
+    std::vector<uint8_t> _rom;
+
+    // Addresses starting a basic block.
+    std::set<uint16_t> _leaders;
+
+    // Addresses of instructions reachable statically.
+    std::bitset<0x1000> _reached;
+
+    uint16_t _code_start;
+    uint16_t _code_end;
+};
+
+} // namespace tools::chip8::recompiler
+
+#endif // RECOMPILER_HPP
@@ -0,0 +1,79 @@
+#include "recompiler/Runtime.hpp"
+
+#include "spdlog/spdlog.h"
+
+namespace tools::chip8::recompiler {
+
+Runtime::Runtime(const std::vector<uint8_t> &rom, uint16_t code_start, uint16_t code_end) {
+    _code_start = code_start;
+    _code_end = code_end;
+    load_rom(rom);
+}
+
+Runtime::~Runtime() {}
+
+bool Runtime::is_native() {
+    return _native;
+}
+
+uint8_t *Runtime::v() {
+    return _v;
+}
+
+uint16_t &Runtime::i() {
+    return _i;
+}
+
+uint16_t &Runtime::pc() {
+    return _pc;
+}
+
+bool Runtime::push(uint16_t addr) {
+    if (_sp == STACK_SIZE)
+        return false;
+    _stack[_sp++] = addr;
+    return true;
+}
+
+uint16_t Runtime::pop(uint16_t fallback) {
+    if (_sp == 0)
+        return fallback;
+    return _stack[--_sp];
+}
+
+void Runtime::execute(uint16_t opcode) {
+    uint16_t first = _i;
+    decode_execute(opcode);
+
+    // Only Fx33 and Fx55 write to memory, from I onwards.
+    if (!_native || (opcode & 0xf000) != 0xf000)
+        return;
+
+    uint16_t last;
+    if ((opcode & 0x00ff) == 0x33)
+        last = first + 2;
+    else if ((opcode & 0x00ff) == 0x55)
+        last = first + ((opcode >> 8) & 0x000f);
+    else
+        return;
+
+    // Addresses wrap to 12 bits like write_memory() does,
+    // a range crossing 0xfff covers first to 0xfff then 0 to last.
+    first &= 0x0fff;
+    last &= 0x0fff;
+    bool wrapped = last < first;
+    bool overlaps = wrapped
+        ? first < _code_end || last >= _code_start
+        : first < _code_end && last >= _code_start;
+
+    if (overlaps) {
+        SPDLOG_INFO("Program wrote into its code at 0x{:03X}, switching to the interpreter.", first);
+        _native = false;
+    }
+}
+
+void Runtime::interpret() {
+    execute(fetch());
+}
+
+} // namespace tools::chip8::recompiler
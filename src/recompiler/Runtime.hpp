@@ -0,0 +1,66 @@
+#ifndef RUNTIME_HPP
+#define RUNTIME_HPP
+
+#include "Chip8.hpp"
+
+namespace tools::chip8::recompiler {
+
+/**
+ * Base class of the sources generated by Recompiler.
+ * Gives native code direct access to the machine state
+ * and falls back to the interpreter for the rest.
+ */
+class Runtime : public Chip8 {
+    public:
+
+    /**
+     * @brief Load the recompiled rom.
+     * @param code_start First address of the recompiled code.
+     * @param code_end Address following the last recompiled instruction.
+     */
+    Runtime(const std::vector<uint8_t> &rom, uint16_t code_start, uint16_t code_end);
+
+    virtual ~Runtime();
+
+    /**
+     * @brief Execute up to budget instructions, natively when possible.
+     * @return Number of instructions executed.
+     */
+    virtual uint32_t run_native(uint32_t budget) = 0;
+
+    /**
+     * @brief Whether the native code still matches memory.
+     * Becomes false for good once the program writes into its own code.
+     */
+    bool is_native();
+
+
+    protected:
+
+    uint8_t *v();
+    uint16_t &i();
+    uint16_t &pc();
+
+    // Same behaviour as 2nnn and 00EE on stack faults.
+    // push() returns false when the stack is full,
+    // pop() returns fallback when the stack is empty.
+    bool push(uint16_t addr);
+    uint16_t pop(uint16_t fallback);
+
+    // Execute an opcode with the interpreter, pc must point after it.
+    void execute(uint16_t opcode);
+
+    // Execute the instruction at pc with the interpreter.
+    void interpret();
+
+
+    private:
+
+    uint16_t _code_start;
+    uint16_t _code_end;
+    bool _native = true;
+};
+
+} // namespace tools::chip8::recompiler
+
+#endif // RUNTIME_HPP
@@ -0,0 +1,27 @@
+#include "spdlog/spdlog.h"
+
+#include "recompiler/Recompiler.hpp"
+
+int main(int argc, char **argv) {
+    if (argc < 4 || argc > 5) {
+        SPDLOG_INFO("Usage : chip8-recompiler [rom name] [output cpp] [class name] [quirks profile]");
+        return 0;
+    }
+
+    tools::chip8::recompiler::Recompiler recompiler;
+    if (!recompiler.load_rom(argv[1]))
+        return 1;
+
+    if (argc >= 5 && !recompiler.set_quirks_profile(argv[4]))
+        return 1;
+
+    recompiler.analyze();
+
+    if (!recompiler.write(argv[3], argv[2])) {
+        SPDLOG_ERROR("Failed to write '{}'.", argv[2]);
+        return 1;
+    }
+
+    SPDLOG_INFO("Wrote '{}'.", argv[2]);
+    return 0;
+}
@@ -0,0 +1,267 @@
+#include "spdlog/spdlog.h"
+
+#include "Chip8.hpp"
+#include "files.hpp"
+#include "ThreadPool.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+
+using tools::chip8::Chip8;
+
+struct Options {
+    std::string rom;
+    std::vector<uint32_t> cpu_freqs = { 500, 700, 1000 };
+    std::vector<uint32_t> timer_rates = { 60 };
+    std::vector<std::string> quirks = { "" };
+    uint64_t frames = 600;
+    uint64_t interval = 60;
+    uint64_t seed = 0;
+    unsigned threads = 0;
+    bool json = false;
+    std::string output;
+};
+
+// One point of the matrix and what it did.
+struct Config {
+    uint32_t cpu_freq;
+    uint32_t timer_rate;
+    std::string quirks;
+
+    bool loaded = false;
+    uint64_t executed = 0;
+    uint64_t idle = 0;
+    // Screen every interval frames, then at the last frame.
+    std::vector<uint64_t> hashes;
+    // Same hashes as the fastest cpu of the same quirks and timer rate.
+    bool matches = false;
+};
+
+void usage() {
+    SPDLOG_INFO("Usage : chip8-sweep [rom name] [options]");
+    SPDLOG_INFO("  --cpu-freq LIST     instructions per second of emulated time (default 500,700,1000)");
+    SPDLOG_INFO("  --timer-rate LIST   timer ticks per second (default 60)");
+    SPDLOG_INFO("  --quirks LIST       quirks profiles, 'all' for every profile (default none)");
+    SPDLOG_INFO("  --frames N          frames of 1/60 s per run (default 600)");
+    SPDLOG_INFO("  --interval N        frames between two recorded hashes (default 60)");
+    SPDLOG_INFO("  --seed N            seed of the random generator (default 0)");
+    SPDLOG_INFO("  --threads N         threads, calling thread included (default all)");
+    SPDLOG_INFO("  --json              write json instead of csv");
+    SPDLOG_INFO("  --output PATH       write the table to a file instead of the standard output");
+}
+
+std::vector<std::string> split(const std::string &text) {
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos)
+            end = text.size();
+        items.push_back(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
+std::vector<uint32_t> parse_numbers(const std::string &text) {
+    std::vector<uint32_t> numbers;
+    for (const std::string &item : split(text))
+        numbers.push_back(std::stoul(item));
+    return numbers;
+}
+
+void run(const std::vector<uint8_t> &rom, const Options &options, Config &config) {
+    using StopReason = Chip8::StopReason;
+
+    Chip8 cpu;
+    if (!cpu.load_rom(rom))
+        return;
+    if (!config.quirks.empty() && !cpu.set_quirks_profile(config.quirks))
+        return;
+    cpu.seed(options.seed);
+    cpu.set_backend(Chip8::Backend::predecoded);
+    config.loaded = true;
+
+    uint32_t remainder = 0, timer_remainder = 0;
+
+    for (uint64_t frame = 1 ; frame <= options.frames ; ++frame) {
+        // Spread cpu_freq instructions over 60 frames without drifting.
+        remainder += config.cpu_freq;
+        uint32_t budget = remainder / 60;
+        remainder %= 60;
+
+        while (budget > 0) {
+            Chip8::RunResult result = cpu.run(budget);
+            config.executed += result.executed;
+            budget -= result.executed;
+
+            if (result.reason == StopReason::halt_loop
+                || result.reason == StopReason::idle
+                || result.reason == StopReason::waiting_for_key) {
+                // Nothing happens until the next frame.
+                config.idle += budget;
+                break;
+            }
+        }
+
+        // Same for the timers at their own rate.
+        timer_remainder += config.timer_rate;
+        for ( ; timer_remainder >= 60 ; timer_remainder -= 60)
+            cpu.decrease_timers();
+
+        if (frame % options.interval == 0 || frame == options.frames)
+            config.hashes.push_back(cpu.frame_hash());
+    }
+}
+
+std::string hashes_text(const Config &config) {
+    std::string text;
+    for (uint64_t hash : config.hashes)
+        text += fmt::format("{}{:016x}", text.empty() ? "" : " ", hash);
+    return text;
+}
+
+double idle_fraction(const Config &config) {
+    uint64_t total = config.executed + config.idle;
+    return total == 0 ? 0.0 : (double)config.idle / total;
+}
+
+void write_csv(std::ostream &out, const std::vector<Config> &configs, const Options &options) {
+    out << "cpu_freq,timer_rate,quirks,instructions,instructions_per_frame,idle,matches,hashes\n";
+    for (const Config &config : configs) {
+        if (!config.loaded)
+            continue;
+        out << fmt::format("{},{},{},{},{:.2f},{:.4f},{},{}\n",
+            config.cpu_freq, config.timer_rate, config.quirks, config.executed,
+            (double)config.executed / options.frames, idle_fraction(config),
+            config.matches ? 1 : 0, hashes_text(config));
+    }
+}
+
+void write_json(std::ostream &out, const std::vector<Config> &configs, const Options &options) {
+    out << "[\n";
+    bool first = true;
+    for (const Config &config : configs) {
+        if (!config.loaded)
+            continue;
+
+        std::string hashes;
+        for (uint64_t hash : config.hashes)
+            hashes += fmt::format("{}\"{:016x}\"", hashes.empty() ? "" : ", ", hash);
+
+        out << fmt::format("{}  {{ \"cpu_freq\": {}, \"timer_rate\": {}, \"quirks\": \"{}\", "
+            "\"instructions\": {}, \"instructions_per_frame\": {:.2f}, \"idle\": {:.4f}, "
+            "\"matches\": {}, \"hashes\": [{}] }}",
+            first ? "" : ",\n", config.cpu_freq, config.timer_rate, config.quirks,
+            config.executed, (double)config.executed / options.frames, idle_fraction(config),
+            config.matches ? "true" : "false", hashes);
+        first = false;
+    }
+    out << "\n]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage();
+        return 0;
+    }
+
+    Options options;
+    options.rom = argv[1];
+
+    for (int i = 2 ; i < argc ; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--cpu-freq" && has_value)
+            options.cpu_freqs = parse_numbers(argv[++i]);
+        else if (arg == "--timer-rate" && has_value)
+            options.timer_rates = parse_numbers(argv[++i]);
+        else if (arg == "--quirks" && has_value) {
+            std::string list = argv[++i];
+            options.quirks = list == "all" ? tools::chip8::quirks_profiles() : split(list);
+        }
+        else if (arg == "--frames" && has_value)
+            options.frames = std::stoull(argv[++i]);
+        else if (arg == "--interval" && has_value)
+            options.interval = std::stoull(argv[++i]);
+        else if (arg == "--seed" && has_value)
+            options.seed = std::stoull(argv[++i]);
+        else if (arg == "--threads" && has_value)
+            options.threads = std::stoul(argv[++i]);
+        else if (arg == "--json")
+            options.json = true;
+        else if (arg == "--output" && has_value)
+            options.output = argv[++i];
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    for (uint32_t cpu_freq : options.cpu_freqs) {
+        if (cpu_freq < 60) {
+            SPDLOG_ERROR("CPU frequency must be at least 60 Hz.");
+            return 1;
+        }
+    }
+
+    if (options.frames == 0 || options.interval == 0) {
+        SPDLOG_ERROR("Frames and interval must be at least 1.");
+        return 1;
+    }
+
+    std::vector<uint8_t> rom = tools::utils::files::read_binary_file(options.rom);
+    if (rom.empty()) {
+        SPDLOG_ERROR("Failed to read rom '{}'.", options.rom);
+        return 1;
+    }
+
+    std::vector<Config> configs;
+    for (const std::string &quirks : options.quirks) {
+        for (uint32_t timer_rate : options.timer_rates) {
+            for (uint32_t cpu_freq : options.cpu_freqs)
+                configs.push_back({ cpu_freq, timer_rate, quirks, false, 0, 0, {}, false });
+        }
+    }
+
+    tools::utils::ThreadPool pool(options.threads);
+    pool.parallel_for(configs.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t c = begin ; c < end ; ++c)
+            run(rom, options, configs[c]);
+    });
+
+    // Configurations differing by their cpu only are contiguous.
+    size_t group = options.cpu_freqs.size();
+    for (size_t begin = 0 ; begin < configs.size() ; begin += group) {
+        const Config *reference = &configs[begin];
+        for (size_t c = begin ; c < begin + group ; ++c) {
+            if (configs[c].cpu_freq > reference->cpu_freq)
+                reference = &configs[c];
+        }
+        for (size_t c = begin ; c < begin + group ; ++c)
+            configs[c].matches = configs[c].hashes == reference->hashes;
+    }
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            SPDLOG_ERROR("Failed to write '{}'.", options.output);
+            return 1;
+        }
+    }
+    std::ostream &out = options.output.empty() ? std::cout : file;
+
+    if (options.json)
+        write_json(out, configs, options);
+    else
+        write_csv(out, configs, options);
+
+    return 0;
+}
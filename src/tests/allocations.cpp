@@ -0,0 +1,117 @@
+#include "spdlog/spdlog.h"
+
+#include "Chip8.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Instructions run before counting, while the backends decode and translate.
+#define WARMUP_INSTRUCTIONS 100000
+#define COUNTED_INSTRUCTIONS 5000000
+
+namespace {
+
+std::atomic<uint64_t> allocations = 0;
+
+void *allocate(size_t size, size_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size = size == 0 ? alignment : (size + alignment - 1) / alignment * alignment;
+    if (void *memory = aligned_alloc(alignment, size))
+        return memory;
+    throw std::bad_alloc();
+}
+
+using tools::chip8::Chip8;
+
+// Calls, returns, arithmetic, random values, memory writes outside the code,
+// drawing and timers, in a loop that never ends.
+const std::vector<uint8_t> rom = {
+    0x60, 0x00,     // 200: V0 = 0
+    0x61, 0x05,     // 202: V1 = 5
+    0x22, 0x20,     // 204: call 220
+    0x70, 0x01,     // 206: V0 += 1
+    0x80, 0x14,     // 208: V0 += V1
+    0xc2, 0xff,     // 20a: V2 = random
+    0xa8, 0x00,     // 20c: I = 800
+    0xf2, 0x33,     // 20e: BCD of V2 at I
+    0xf2, 0x55,     // 210: store V0 to V2 at I
+    0xf2, 0x65,     // 212: load V0 to V2 from I
+    0xf0, 0x29,     // 214: I = sprite of V0
+    0xd1, 0x25,     // 216: draw at V1, V2
+    0xf0, 0x15,     // 218: delay timer = V0
+    0xf3, 0x07,     // 21a: V3 = delay timer
+    0x12, 0x00,     // 21c: jump 200
+    0x00, 0x00,     // 21e
+    0x81, 0x20,     // 220: V1 = V2
+    0x81, 0x26,     // 222: V1 >>= 1
+    0x00, 0xee      // 224: return
+};
+
+// Run count instructions with run(), ticking the timers between calls.
+void run(Chip8 &cpu, uint64_t count) {
+    for (uint64_t executed = 0 ; executed < count ; ) {
+        executed += cpu.run(1000).executed;
+        cpu.decrease_timers();
+    }
+}
+
+bool check(Chip8::Backend backend, const char *name) {
+    Chip8 cpu;
+    cpu.set_backend(backend);
+    cpu.seed(0);
+    if (!cpu.load_rom(rom))
+        return false;
+
+    run(cpu, WARMUP_INSTRUCTIONS);
+    for (int i = 0 ; i < WARMUP_INSTRUCTIONS ; ++i)
+        cpu.next_instruction();
+
+    uint64_t before = allocations.load();
+    run(cpu, COUNTED_INSTRUCTIONS);
+    for (int i = 0 ; i < COUNTED_INSTRUCTIONS ; ++i)
+        cpu.next_instruction();
+    uint64_t count = allocations.load() - before;
+
+    if (count != 0) {
+        SPDLOG_ERROR("{} : {} allocations in {} instructions.", name, count, 2 * COUNTED_INSTRUCTIONS);
+        return false;
+    }
+    SPDLOG_INFO("{} : no allocation in {} instructions.", name, 2 * COUNTED_INSTRUCTIONS);
+    return true;
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return allocate(size, std::max((size_t)alignment, alignof(std::max_align_t)));
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept {
+    free(memory);
+}
+
+int main() {
+    bool ok = check(Chip8::Backend::interpreter, "interpreter");
+    ok = check(Chip8::Backend::predecoded, "predecoded") && ok;
+    ok = check(Chip8::Backend::jit, "jit") && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include "spdlog/spdlog.h"
+
+#include "Chip8.hpp"
+#include "recompiler/Runtime.hpp"
+
+#include <memory>
+#include <string>
+
+// Frames run by each rom, keys are held over a part of them.
+#define FRAMES 600
+#define KEYS_FROM 100
+#define KEYS_TO 160
+#define HELD_KEYS 0x0020
+#define CPU_FREQ 1000
+#define SEED 1
+
+using tools::chip8::Chip8;
+using tools::chip8::recompiler::Runtime;
+
+// Built from src/tests/conformance/counter.ch8 by chip8_recompile().
+std::unique_ptr<Runtime> make_counter();
+std::unique_ptr<Runtime> make_counter_chip8();
+
+namespace {
+
+// Run a frame worth of instructions, until the rom halts.
+void run_frame(Chip8 &cpu, uint32_t budget) {
+    using StopReason = Chip8::StopReason;
+
+    while (budget > 0) {
+        Chip8::RunResult result = cpu.run(budget);
+        budget -= result.executed;
+
+        if (result.reason == StopReason::halt_loop
+            || result.reason == StopReason::waiting_for_key)
+            break;
+    }
+}
+
+bool check(Runtime &native, const std::string &rom, const std::string &quirks, const char *name) {
+    Chip8 cpu;
+    if (!cpu.load_rom(rom) || !cpu.set_quirks_profile(quirks))
+        return false;
+    cpu.seed(SEED);
+    native.seed(SEED);
+
+    uint32_t remainder = 0;
+    for (int frame = 0 ; frame < FRAMES ; ++frame) {
+        uint16_t keys = frame >= KEYS_FROM && frame < KEYS_TO ? HELD_KEYS : 0;
+        cpu.set_keys(keys);
+        native.set_keys(keys);
+
+        // Spread cpu_freq instructions over 60 frames without drifting.
+        remainder += CPU_FREQ;
+        uint32_t budget = remainder / 60;
+        remainder %= 60;
+
+        run_frame(cpu, budget);
+        native.run_native(budget);
+        cpu.decrease_timers();
+        native.decrease_timers();
+
+        if (native.frame_hash() != cpu.frame_hash() || native.state_hash() != cpu.state_hash()) {
+            SPDLOG_ERROR("{} : frame {} frame and state hashes are {:016x} {:016x}, the interpreter has {:016x} {:016x}.",
+                name, frame, native.frame_hash(), native.state_hash(), cpu.frame_hash(), cpu.state_hash());
+            return false;
+        }
+    }
+
+    SPDLOG_INFO("{} : same frames as the interpreter over {} frames.", name, FRAMES);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        SPDLOG_INFO("Usage : chip8-test-recompiled [path of counter.ch8]");
+        return 1;
+    }
+    std::string rom = argv[1];
+
+    bool ok = check(*make_counter(), rom, "default", "counter");
+    ok = check(*make_counter_chip8(), rom, "chip8", "counter_chip8") && ok;
+    return ok ? 0 : 1;
+}
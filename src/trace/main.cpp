@@ -0,0 +1,25 @@
+#include "spdlog/spdlog.h"
+
+#include "Disassembler.hpp"
+#include "Trace.hpp"
+
+#include <cstdio>
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        SPDLOG_INFO("Usage : chip8-trace [trace file]");
+        return 0;
+    }
+
+    auto records = tools::chip8::Trace::load(argv[1]);
+    if (records.empty())
+        return 1;
+
+    for (const auto &record : records) {
+        std::string text = tools::chip8::disassemble(record.opcode);
+        printf("%03X  %04X  %-18s V%X = %02X  I = %03X\n",
+            record.pc, record.opcode, text.c_str(), record.x, record.vx, record.i);
+    }
+
+    return 0;
+}